@@ -0,0 +1,70 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that live as long as their owner, e.g. the shaders, textures
+// and geometries of a scene. Objects are placed one after the other in large blocks and
+// destroyed together, in reverse order of creation, by clear() or the destructor.
+class Arena {
+	struct Block {
+		std::unique_ptr<unsigned char[]> memory;
+		size_t size, used;
+	};
+	struct Destructor {
+		void* object;
+		void (*destroy)(void* object);
+	};
+
+	std::vector<Block> blocks;
+	std::vector<Destructor> destructors;
+	size_t blockSize;
+
+public:
+	explicit Arena(size_t _blockSize = 64 * 1024) : blockSize(_blockSize) {}
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	~Arena() { clear(); }
+
+	// alignment up to that of new[], a power of two
+	void* allocate(size_t size, size_t alignment) {
+		if (!blocks.empty()) {
+			Block& block = blocks.back();
+			size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+			if (offset + size <= block.size) {
+				block.used = offset + size;
+				return block.memory.get() + offset;
+			}
+		}
+		size_t bytes = std::max(size, blockSize);
+		blocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[bytes]), bytes, size });
+		return blocks.back().memory.get();
+	}
+
+	template<class T, class... Args> T* create(Args&&... args) {
+		T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if constexpr (!std::is_trivially_destructible<T>::value) {
+			destructors.push_back({ object, [](void* p) { static_cast<T*>(p)->~T(); } });
+		}
+		return object;
+	}
+
+	void clear() {
+		for (size_t i = destructors.size(); i > 0; i--) destructors[i - 1].destroy(destructors[i - 1].object);
+		destructors.clear();
+		blocks.clear();
+	}
+
+	size_t bytesAllocated() const {
+		size_t bytes = 0;
+		for (const Block& block : blocks) bytes += block.size;
+		return bytes;
+	}
+};
+
+#endif // ARENA_H
@@ -0,0 +1,43 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// The draws of a frame, put in the order that changes the least GL state between them:
+// by program, then texture, material and vertex array, the most expensive change first.
+// GLStateCache and the uniform values of GPUProgram then leave out what stays the same.
+// Draws of equal state are ordered by their index.
+class DrawList {
+public:
+	struct Item {
+		unsigned int program, texture;
+		const void* material;
+		unsigned int vertexArray;
+		int index; // of whatever is drawn, for the one who fills the list
+
+		bool operator<(const Item& other) const {
+			if (program != other.program) return program < other.program;
+			if (texture != other.texture) return texture < other.texture;
+			if (material != other.material) return std::less<const void*>()(material, other.material);
+			if (vertexArray != other.vertexArray) return vertexArray < other.vertexArray;
+			return index < other.index;
+		}
+	};
+
+	void clear() { items.clear(); }
+	void add(unsigned int program, unsigned int texture, const void* material, unsigned int vertexArray, int index) {
+		items.push_back({ program, texture, material, vertexArray, index });
+	}
+	void sort() { std::sort(items.begin(), items.end()); }
+
+	size_t size() const { return items.size(); }
+	std::vector<Item>::const_iterator begin() const { return items.begin(); }
+	std::vector<Item>::const_iterator end() const { return items.end(); }
+
+private:
+	std::vector<Item> items; // reused from frame to frame
+};
+
+#endif // DRAW_LIST_H
@@ -0,0 +1,113 @@
+#include "fileWatcher.h"
+#include <stdio.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// how often the thread checks for being stopped, and the modification times without inotify
+const int pollMilliseconds = 200;
+
+long long modificationTime(const std::string& path) {
+	std::error_code error;
+	auto time = std::filesystem::last_write_time(path, error);
+	return error ? 0 : (long long)time.time_since_epoch().count();
+}
+
+} // namespace
+
+FileWatcher::FileWatcher() : running(false) {}
+
+FileWatcher::~FileWatcher() {
+	running = false;
+	if (thread.joinable()) thread.join();
+#ifdef __linux__
+	if (inotify >= 0) close(inotify);
+#endif
+}
+
+void FileWatcher::watch(const std::vector<std::string>& paths) {
+#ifndef __EMSCRIPTEN__
+	std::lock_guard<std::mutex> lock(mutex);
+#ifdef __linux__
+	if (inotify < 0) inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	for (const std::string& path : paths) {
+		std::filesystem::path file(path);
+		File watched = { path, file.parent_path().string(), file.filename().string(), modificationTime(path), -1 };
+		if (watched.directory.empty()) watched.directory = ".";
+#ifdef __linux__
+		// a directory is watched once, adding it again returns the same watch
+		if (inotify >= 0) watched.directoryWatch = inotify_add_watch(inotify, watched.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (inotify >= 0 && watched.directoryWatch < 0) printf("Cannot watch %s for changes\n", watched.directory.c_str());
+#endif
+		files.push_back(watched);
+	}
+	if (!running) {
+		running = true;
+		thread = std::thread(&FileWatcher::run, this);
+	}
+#endif
+}
+
+std::vector<std::pair<std::string, std::string>> FileWatcher::takeChanges() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<std::pair<std::string, std::string>> taken;
+	taken.swap(changes);
+	return taken;
+}
+
+// on the watcher thread, with the mutex locked
+void FileWatcher::changed(const File& file) {
+	std::ifstream stream(file.path, std::ios::in);
+	if (!stream.is_open()) return; // renamed away, the new one follows
+	std::stringstream contents;
+	contents << stream.rdbuf();
+	for (auto& change : changes) {
+		if (change.first == file.path) {
+			change.second = contents.str();
+			return;
+		}
+	}
+	changes.emplace_back(file.path, contents.str());
+}
+
+void FileWatcher::run() {
+	while (running) {
+#ifdef __linux__
+		if (inotify >= 0) {
+			pollfd descriptor = { inotify, POLLIN, 0 };
+			if (poll(&descriptor, 1, pollMilliseconds) <= 0) continue;
+			alignas(inotify_event) char buffer[4096];
+			ssize_t length;
+			while ((length = read(inotify, buffer, sizeof(buffer))) > 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event*)p)->len) {
+					const inotify_event* event = (const inotify_event*)p;
+					if (event->len == 0) continue;
+					for (const File& file : files) {
+						if (file.directoryWatch == event->wd && file.name == event->name) changed(file);
+					}
+				}
+			}
+			continue;
+		}
+#endif
+		std::this_thread::sleep_for(std::chrono::milliseconds(pollMilliseconds));
+		std::lock_guard<std::mutex> lock(mutex);
+		for (File& file : files) {
+			long long modified = modificationTime(file.path);
+			if (modified == file.modified) continue;
+			file.modified = modified;
+			changed(file);
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Reports files that were written, e.g. shaders edited while the program runs. A
+// background thread waits for the changes, with inotify on Linux and by comparing
+// modification times elsewhere, and reads the new contents, so the caller only picks
+// them up. Watching directories catches editors that save by renaming a new file over
+// the old one. Does nothing on the web, which has no files to edit.
+class FileWatcher {
+	struct File {
+		std::string path, directory, name;
+		long long modified; // last write time where there is no inotify
+		int directoryWatch; // inotify watch of the directory
+	};
+
+	std::vector<File> files;
+	std::vector<std::pair<std::string, std::string>> changes; // path, contents
+	std::mutex mutex;
+	std::thread thread;
+	std::atomic<bool> running;
+	int inotify = -1;
+
+	void run();
+	void changed(const File& file);
+
+public:
+	FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	void operator=(const FileWatcher&) = delete;
+	~FileWatcher();
+
+	// Starts watching, the files must exist. Paths are reported as given.
+	void watch(const std::vector<std::string>& paths);
+	// The files written since the last call with their contents, the latest one per file
+	std::vector<std::pair<std::string, std::string>> takeChanges();
+};
+
+#endif // FILE_WATCHER_H
@@ -1,5 +1,16 @@
 #include "frameworkMath.h"
 #include "geometry.h"
+#include "resourceLoader.h"
 #include "gpuProgram.h"
+#include "glStateCache.h"
+#include "drawList.h"
+#include "programCache.h"
 #include "shader.h"
-#include "texture.h"
\ No newline at end of file
+#include "fileWatcher.h"
+#include "texture.h"
+#include "textureData.h"
+#include "mappedFile.h"
+#include "profiler.h"
+#include "uniformBuffer.h"
+#include "renderBackend.h"
+#include "arena.h"
\ No newline at end of file
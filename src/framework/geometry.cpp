@@ -1,29 +1,128 @@
 #include "geometry.h"
+#include "renderBackend.h"
+#include "profiler.h"
+#include "glStateCache.h"
 
 #ifdef __EMSCRIPTEN__
 #include <GLES3/gl3.h>
 #else
 #include <glad/glad.h>
 #endif
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <memory>
+#include "parallel.h"
 
-Geometry::Geometry() {
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glGenBuffers(1, &vbo); // Generate 1 vertex buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+// Meshes from this size on are tessellated on all threads
+const int parallelTessellationVertices = 16384;
+
+namespace {
+
+unsigned short floatToHalf(float f) {
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    unsigned int mantissa = bits & 0x7FFFFF;
+    if (exponent >= 31) return (unsigned short)(sign | 0x7C00); // overflow to infinity
+    if (exponent <= 0) {                                         // subnormal or zero
+        if (exponent < -10) return (unsigned short)sign;
+        mantissa |= 0x800000;
+        unsigned int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return (unsigned short)(sign | half);
+    }
+    unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+    unsigned int rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++; // round to nearest even
+    return (unsigned short)half;
+}
+
+short toSnorm16(float f) {
+    f = f < -1.0f ? -1.0f : (f > 1.0f ? 1.0f : f);
+    return (short)lroundf(f * 32767.0f);
 }
 
-Geometry::~Geometry() {
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
+unsigned short toUnorm16(float f) {
+    f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+    return (unsigned short)lroundf(f * 65535.0f);
 }
 
-void Geometry::bindBuffer() {
+// Octahedral normal encoding, decoded by decodeNormal in geom.vert
+void encodeNormal(const vec4& n, short out[2]) {
+    float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    float x = 0, y = 0;
+    if (sum > 0.0f) { // degenerate normals (e.g. at the poles) become +z
+        x = n.x / sum;
+        y = n.y / sum;
+        if (n.z < 0.0f) {
+            float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+    }
+    out[0] = toSnorm16(x);
+    out[1] = toSnorm16(y);
+}
+
+} // namespace
+
+VertexFormat ParamGeometry::vertexFormat = VertexFormat::Float;
+unsigned int ParamGeometry::tessellationThreads = 0;
+
+ParamGeometry::ParamGeometry() : boundRadius(0.0f), boundMin(FLT_MAX, FLT_MAX, FLT_MAX), boundMax(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+
+ParamGeometry::~ParamGeometry() {
+    for (ParamMesh& mesh : levels) {
+        if (mesh.backendMesh > 0) RenderBackend::get()->deleteMesh(mesh.backendMesh);
+        if (mesh.vbo > 0) glDeleteBuffers(1, &mesh.vbo);
+        if (mesh.ibo > 0) glDeleteBuffers(1, &mesh.ibo);
+        if (mesh.instanceVbo > 0) glDeleteBuffers(1, &mesh.instanceVbo);
+        if (mesh.vao > 0) {
+            GLStateCache::forgetVertexArray(mesh.vao);
+            glDeleteVertexArrays(1, &mesh.vao);
+        }
+    }
+}
+
+InstanceBuffer::~InstanceBuffer() {
+    if (vbo > 0) glDeleteBuffers(1, &vbo);
+}
+
+void InstanceBuffer::upload(const std::vector<InstanceData>& instances) {
+    count = instances.size();
+    if (RenderBackend::get()) return;
+    if (vbo == 0) glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STATIC_DRAW);
 }
 
+// Points attributes 3-10 of the mesh's vao into buffer, unless they already do
+void ParamGeometry::bindInstanceAttributes(ParamMesh& mesh, unsigned int buffer) {
+    if (mesh.instanceSource == buffer) return;
+    GLStateCache::bindVertexArray(mesh.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    // a mat4 attribute takes 4 locations, one per row of our row-major mat4
+    const size_t offsets[3] = { offsetof(InstanceData, ScaleRotate), offsetof(InstanceData, Translate), offsetof(InstanceData, Normal) };
+    for (int row = 0; row < 12; row++) {
+        size_t offset = offsets[row / 4] + (row % 4) * sizeof(vec4);
+        glEnableVertexAttribArray(3 + row);
+        glVertexAttribPointer(3 + row, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+        glVertexAttribDivisor(3 + row, 1);
+    }
+    mesh.instanceSource = buffer;
+}
 
-ParamGeometry::ParamGeometry() : nVtxPerStrip(0), nStrips(0) {}
+void ParamGeometry::uploadInstances(ParamMesh& mesh, const std::vector<InstanceData>& instances) {
+    if (mesh.instanceVbo == 0) glGenBuffers(1, &mesh.instanceVbo);
+    bindInstanceAttributes(mesh, mesh.instanceVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STREAM_DRAW);
+}
 
 VertexData ParamGeometry::GenVertexData(float u, float v) {
     VertexData vtxData;
@@ -43,31 +142,355 @@ VertexData ParamGeometry::GenVertexData(float u, float v) {
     return vtxData;
 }
 
+// Evaluates the (N + 1) x (M + 1) vertex grid, row i at v = i / N, handing vertex k to store(k, vertex).
+// Rows are spread over the threads; every vertex is computed the same way as serially.
+template<class Store>
+void ParamGeometry::tessellate(int N, int M, const Store& store) {
+    int nVertices = (N + 1) * (M + 1);
+    parallelFor(N + 1, [&](int i) {
+        for (int j = 0; j <= M; j++) {
+            store(i * (M + 1) + j, GenVertexData((float)j / M, (float)i / N));
+        }
+    }, nVertices >= parallelTessellationVertices ? tessellationThreads : 1);
+}
+
 void ParamGeometry::create(int N, int M) {
-    nVtxPerStrip = (M + 1) * 2;
-    nStrips = N;
-    std::vector<VertexData> vtxData;    // vertices on the CPU
-    
-    // Generate vertex data
+    levels.assign(1, ParamMesh());
+    tessellationLevelIndex = 0;
+    levels[0].N = N;
+    levels[0].M = M;
+    LevelMeasures measures = measure(N, M);
+    setMeasures(levels[0], measures);
+    setBounds(measures);
+    build(levels[0]);
+}
+
+void ParamGeometry::createLevels(int coarsest, int finest) {
+    int start = std::max(coarsest, std::min(tessellationLevel, finest));
+    std::vector<int> sizes;
+    for (float n = (float)start; lroundf(n) >= coarsest; n /= sqrtf(2.0f)) {
+        if (sizes.empty() || lroundf(n) < sizes.front()) sizes.insert(sizes.begin(), (int)lroundf(n));
+    }
+    tessellationLevelIndex = (int)sizes.size() - 1;
+    for (float n = start * sqrtf(2.0f); sizes.back() < finest; n *= sqrtf(2.0f)) {
+        int N = std::min((int)lroundf(n), finest);
+        if (N > sizes.back()) sizes.push_back(N);
+    }
+
+    levels.clear();
+    for (int N : sizes) {
+        levels.push_back(ParamMesh());
+        levels.back().N = levels.back().M = N;
+    }
+    ResourceLoader* loader = ResourceLoader::get();
+    ParamMesh& defaultMesh = levels[tessellationLevelIndex];
+    if (!loader || RenderBackend::get()) {
+        LevelMeasures measures = measure(defaultMesh.N, defaultMesh.M);
+        setMeasures(defaultMesh, measures);
+        setBounds(measures);
+        return;
+    }
+    // The render thread reads the bounds of every geometry, ready or not, so the loader
+    // thread measures into measures and the upload sets them on the render thread
+    streaming = true;
+    VertexFormat format = vertexFormat;
+    std::shared_ptr<LevelMeasures> measures = std::make_shared<LevelMeasures>();
+    int N = defaultMesh.N, M = defaultMesh.M;
+    loader->add([this, format, measures, N, M](std::vector<unsigned char>& bytes) {
+        *measures = measure(N, M);
+        stage(levels[tessellationLevelIndex], format, bytes);
+    }, [this, format, measures](const ResourceLoader::Staged& staged) {
+        setMeasures(levels[tessellationLevelIndex], *measures);
+        setBounds(*measures);
+        upload(levels[tessellationLevelIndex], format, staged);
+        streaming = false;
+    });
+}
+
+ParamMesh& ParamGeometry::mesh(int level) {
+    ParamMesh& mesh = levels[std::max(0, std::min(level, (int)levels.size() - 1))];
+    if (!mesh.built) build(mesh);
+    return mesh;
+}
+
+// Compares the triangles of the level with the surface at the midpoints of the grid
+// edges and of the diagonal the strip splits the quads along.
+ParamGeometry::LevelMeasures ParamGeometry::measure(int N, int M) {
+    PROFILE_ZONE("ParamGeometry::measure");
+    std::vector<vec3> grid((N + 1) * (M + 1));
+    tessellate(N, M, [&](int k, const VertexData& vertex) { grid[k] = vec3(vertex.position.x, vertex.position.y, vertex.position.z); });
+
+    std::vector<float> rowError(N + 1, 0.0f), rowEdge(N + 1, 0.0f), rowRadius(N + 1, 0.0f);
+    parallelFor(N + 1, [&](int i) {
+        auto deviation = [&](float u, float v, const vec3& p, const vec3& q) {
+            vec4 s = GenVertexData(u, v).position;
+            return euclideanLength(vec3(s.x, s.y, s.z) - (p + q) * 0.5f);
+        };
+        for (int j = 0; j <= M; j++) {
+            const vec3& a = grid[i * (M + 1) + j];
+            rowRadius[i] = std::max(rowRadius[i], euclideanLength(a));
+            if (j < M) {
+                const vec3& b = grid[i * (M + 1) + j + 1];
+                rowError[i] = std::max(rowError[i], deviation((j + 0.5f) / M, (float)i / N, a, b));
+                rowEdge[i] = std::max(rowEdge[i], euclideanLength(b - a));
+            }
+            if (i < N) {
+                const vec3& c = grid[(i + 1) * (M + 1) + j];
+                rowError[i] = std::max(rowError[i], deviation((float)j / M, (i + 0.5f) / N, a, c));
+                rowEdge[i] = std::max(rowEdge[i], euclideanLength(c - a));
+            }
+            if (i < N && j < M) {
+                const vec3& b = grid[i * (M + 1) + j + 1];
+                const vec3& c = grid[(i + 1) * (M + 1) + j];
+                rowError[i] = std::max(rowError[i], deviation((j + 0.5f) / M, (i + 0.5f) / N, b, c));
+                rowEdge[i] = std::max(rowEdge[i], euclideanLength(c - b));
+            }
+        }
+    }, (N + 1) * (M + 1) >= parallelTessellationVertices ? tessellationThreads : 1);
+
+    LevelMeasures measures = { 0.0f, 0.0f, 0.0f, vec3(FLT_MAX, FLT_MAX, FLT_MAX), vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+    for (const vec3& p : grid) {
+        measures.min = vec3(std::min(measures.min.x, p.x), std::min(measures.min.y, p.y), std::min(measures.min.z, p.z));
+        measures.max = vec3(std::max(measures.max.x, p.x), std::max(measures.max.y, p.y), std::max(measures.max.z, p.z));
+    }
+    for (int i = 0; i <= N; i++) {
+        measures.error = std::max(measures.error, rowError[i]);
+        measures.edgeLength = std::max(measures.edgeLength, rowEdge[i]);
+        measures.radius = std::max(measures.radius, rowRadius[i]);
+    }
+    return measures;
+}
+
+void ParamGeometry::setMeasures(ParamMesh& mesh, const LevelMeasures& measures) {
+    mesh.error = measures.error;
+    mesh.edgeLength = measures.edgeLength;
+    mesh.measured = true;
+}
+
+// From one level: every point of the surface is within its error of one of its triangles,
+// which lie inside the bounds of its vertices, so the bounds grown by the error hold the
+// surface and with it the vertices of every level
+void ParamGeometry::setBounds(const LevelMeasures& measures) {
+    vec3 margin(measures.error, measures.error, measures.error);
+    boundRadius = measures.radius + measures.error;
+    boundMin = measures.min - margin;
+    boundMax = measures.max + margin;
+}
+
+ParamMesh& ParamGeometry::measuredLevel(int level) {
+    ParamMesh& mesh = levels[level];
+    if (!mesh.measured) setMeasures(mesh, measure(mesh.N, mesh.M));
+    return mesh;
+}
+
+void ParamGeometry::build(ParamMesh& mesh) {
+    PROFILE_ZONE("ParamGeometry::create");
+    int N = mesh.N, M = mesh.M;
+    size_t nVertices = (size_t)(N + 1) * (M + 1);
+    mesh.built = true;
+
+    std::vector<unsigned int> indices = stripIndices(N, M);
+    mesh.nIndices = (unsigned int)indices.size();
+
+    if (RenderBackend* backend = RenderBackend::get()) {
+        std::vector<VertexData> vertices(nVertices);
+        tessellate(N, M, [&](int k, const VertexData& vertex) { vertices[k] = vertex; });
+        mesh.backendMesh = backend->createMesh(std::move(vertices), std::move(indices));
+        return;
+    }
+
+    // The vertices are packed straight into the mapped vertex buffer.
+    // WebGL cannot map buffers, there they go through a staging copy.
+    glGenVertexArrays(1, &mesh.vao);
+    GLStateCache::bindVertexArray(mesh.vao);
+    glGenBuffers(1, &mesh.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    mesh.format = vertexFormat;
+    size_t stride = vertexSize(mesh.format);
+    glBufferData(GL_ARRAY_BUFFER, nVertices * stride, nullptr, GL_STATIC_DRAW);
+    unsigned char* mapped = nullptr;
+#ifndef __EMSCRIPTEN__
+    mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, nVertices * stride, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+#endif
+    std::vector<unsigned char> staging;
+    unsigned char* destination = mapped;
+    if (!mapped) {
+        staging.resize(nVertices * stride);
+        destination = staging.data();
+    }
+    tessellate(N, M, [&](int k, const VertexData& vertex) { packVertex(vertex, mesh.format, destination + k * stride); });
+#ifndef __EMSCRIPTEN__
+    if (mapped && !glUnmapBuffer(GL_ARRAY_BUFFER)) { // the store got lost meanwhile, e.g. on a mode switch
+        printf("Vertex buffer was corrupted while mapped, uploading it again\n");
+        staging.resize(nVertices * stride);
+        tessellate(N, M, [&](int k, const VertexData& vertex) { packVertex(vertex, mesh.format, staging.data() + k * stride); });
+    }
+#endif
+    if (!staging.empty()) glBufferSubData(GL_ARRAY_BUFFER, 0, staging.size(), staging.data());
+    setVertexAttributes(mesh.format);
+
+    // the element buffer binding is part of the vao
+    glGenBuffers(1, &mesh.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+    if (nVertices <= 0xFFFF) {
+        std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+        mesh.indexType = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), &shortIndices[0], GL_STATIC_DRAW);
+    }
+    else {
+        mesh.indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    }
+}
+
+// One strip per row of quads, joined into a single strip: repeating the last index of a
+// row and the first of the next gives degenerate triangles. Rows have an even index
+// count, so the winding of the following row is kept.
+std::vector<unsigned int> ParamGeometry::stripIndices(int N, int M) {
+    std::vector<unsigned int> indices;
+    indices.reserve(N * (2 * (M + 1) + 2));
     for (int i = 0; i < N; i++) {
+        if (i > 0) {
+            indices.push_back(indices.back());
+            indices.push_back(i * (M + 1));
+        }
         for (int j = 0; j <= M; j++) {
-            vtxData.push_back(GenVertexData((float)j / M, (float)i / N));
-            vtxData.push_back(GenVertexData((float)j / M, (float)(i + 1) / N));
+            indices.push_back(i * (M + 1) + j);
+            indices.push_back((i + 1) * (M + 1) + j);
+        }
+    }
+    return indices;
+}
+
+// The vertices of the mesh packed in format, followed by its indices in the type build
+// would choose, as upload takes them
+void ParamGeometry::stage(const ParamMesh& mesh, VertexFormat format, std::vector<unsigned char>& bytes) {
+    int N = mesh.N, M = mesh.M;
+    size_t nVertices = (size_t)(N + 1) * (M + 1), stride = vertexSize(format);
+    std::vector<unsigned int> indices = stripIndices(N, M);
+    size_t indexSize = nVertices <= 0xFFFF ? sizeof(unsigned short) : sizeof(unsigned int);
+    bytes.resize(nVertices * stride + indices.size() * indexSize);
+    unsigned char* vertices = bytes.data();
+    tessellate(N, M, [&](int k, const VertexData& vertex) { packVertex(vertex, format, vertices + k * stride); });
+    unsigned char* destination = vertices + nVertices * stride;
+    for (unsigned int index : indices) {
+        if (indexSize == sizeof(unsigned short)) {
+            unsigned short shortIndex = (unsigned short)index;
+            memcpy(destination, &shortIndex, indexSize);
+        }
+        else {
+            memcpy(destination, &index, indexSize);
         }
+        destination += indexSize;
+    }
+}
+
+// Builds the buffers of the mesh from what stage left in the loader
+void ParamGeometry::upload(ParamMesh& mesh, VertexFormat format, const ResourceLoader::Staged& staged) {
+    PROFILE_ZONE("ParamGeometry::create");
+    size_t nVertices = (size_t)(mesh.N + 1) * (mesh.M + 1);
+    size_t vertexBytes = nVertices * vertexSize(format), indexBytes = staged.size - vertexBytes;
+    mesh.built = true;
+    mesh.format = format;
+    mesh.indexType = nVertices <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    mesh.nIndices = (unsigned int)(indexBytes / (nVertices <= 0xFFFF ? sizeof(unsigned short) : sizeof(unsigned int)));
+
+    glGenVertexArrays(1, &mesh.vao);
+    GLStateCache::bindVertexArray(mesh.vao);
+    glGenBuffers(1, &mesh.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW);
+    staged.copyTo(GL_ARRAY_BUFFER, 0, vertexBytes, 0);
+    setVertexAttributes(format);
+    glGenBuffers(1, &mesh.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+    staged.copyTo(GL_ELEMENT_ARRAY_BUFFER, vertexBytes, indexBytes, 0);
+}
+
+size_t ParamGeometry::vertexSize(VertexFormat format) {
+    switch (format) {
+    case VertexFormat::Float:   return sizeof(VertexData);
+    case VertexFormat::Compact: return sizeof(CompactVertexData);
+    default:                    return sizeof(HalfVertexData);
     }
+}
 
-    glBufferData(GL_ARRAY_BUFFER, nVtxPerStrip * nStrips * sizeof(VertexData), &vtxData[0], GL_STATIC_DRAW);
+// Writes the vertex in the given layout
+void ParamGeometry::packVertex(const VertexData& vertex, VertexFormat format, unsigned char* destination) {
+    if (format == VertexFormat::Float) {
+        memcpy(destination, &vertex, sizeof(VertexData));
+    }
+    else if (format == VertexFormat::Compact) {
+        CompactVertexData packed;
+        packed.position[0] = vertex.position.x;
+        packed.position[1] = vertex.position.y;
+        packed.position[2] = vertex.position.z;
+        encodeNormal(vertex.normal, packed.normal);
+        packed.texcoord[0] = toUnorm16(vertex.texcoord.x);
+        packed.texcoord[1] = toUnorm16(vertex.texcoord.y);
+        memcpy(destination, &packed, sizeof(packed));
+    }
+    else {
+        HalfVertexData packed;
+        packed.position[0] = floatToHalf(vertex.position.x);
+        packed.position[1] = floatToHalf(vertex.position.y);
+        packed.position[2] = floatToHalf(vertex.position.z);
+        packed.position[3] = 0;
+        encodeNormal(vertex.normal, packed.normal);
+        packed.texcoord[0] = toUnorm16(vertex.texcoord.x);
+        packed.texcoord[1] = toUnorm16(vertex.texcoord.y);
+        memcpy(destination, &packed, sizeof(packed));
+    }
+}
+
+void ParamGeometry::setVertexAttributes(VertexFormat format) {
     glEnableVertexAttribArray(0);  // position
     glEnableVertexAttribArray(1);  // normal
     glEnableVertexAttribArray(2);  // texcoord
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, position));
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, normal));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, texcoord));
+
+    if (format == VertexFormat::Float) {
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, position));
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, texcoord));
+    }
+    else if (format == VertexFormat::Compact) {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CompactVertexData), (void*)offsetof(CompactVertexData, position));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertexData), (void*)offsetof(CompactVertexData, normal));
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertexData), (void*)offsetof(CompactVertexData, texcoord));
+    }
+    else {
+        glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(HalfVertexData), (void*)offsetof(HalfVertexData, position));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(HalfVertexData), (void*)offsetof(HalfVertexData, normal));
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(HalfVertexData), (void*)offsetof(HalfVertexData, texcoord));
+    }
 }
 
-void ParamGeometry::Draw() {
-    glBindVertexArray(vao);
-    for (unsigned int i = 0; i < nStrips; i++) {
-        glDrawArrays(GL_TRIANGLE_STRIP, i * nVtxPerStrip, nVtxPerStrip);
+void ParamGeometry::Draw(int level) {
+    PROFILE_ZONE("ParamGeometry::Draw");
+    ParamMesh& levelMesh = mesh(level);
+    if (RenderBackend* backend = RenderBackend::get()) {
+        backend->drawMesh(levelMesh.backendMesh, levelMesh.nIndices);
+        return;
     }
-}
\ No newline at end of file
+    GLStateCache::bindVertexArray(levelMesh.vao);
+    glDrawElements(GL_TRIANGLE_STRIP, levelMesh.nIndices, levelMesh.indexType, nullptr);
+}
+
+void ParamGeometry::DrawInstanced(const std::vector<InstanceData>& instances, int level) {
+    PROFILE_ZONE("ParamGeometry::DrawInstanced");
+    if (instances.empty()) return;
+    ParamMesh& levelMesh = mesh(level);
+    uploadInstances(levelMesh, instances);
+    GLStateCache::bindVertexArray(levelMesh.vao);
+    glDrawElementsInstanced(GL_TRIANGLE_STRIP, levelMesh.nIndices, levelMesh.indexType, nullptr, (GLsizei)instances.size());
+}
+
+void ParamGeometry::DrawInstanced(const InstanceBuffer& instances, int level) {
+    PROFILE_ZONE("ParamGeometry::DrawInstanced");
+    if (instances.getCount() == 0) return;
+    ParamMesh& levelMesh = mesh(level);
+    bindInstanceAttributes(levelMesh, instances.getVbo());
+    GLStateCache::bindVertexArray(levelMesh.vao);
+    glDrawElementsInstanced(GL_TRIANGLE_STRIP, levelMesh.nIndices, levelMesh.indexType, nullptr, (GLsizei)instances.getCount());
+}
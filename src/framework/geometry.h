@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "frameworkMath.h"
+#include "resourceLoader.h"
 
 const int tessellationLevel = 20;
 
@@ -11,26 +12,136 @@ struct VertexData {
 	vec2 texcoord;
 };
 
+// Vertex layouts of the GL vertex buffer, chosen with ParamGeometry::vertexFormat
+enum class VertexFormat {
+	Float,          // VertexData as is, 40 bytes
+	Compact,        // CompactVertexData, 20 bytes
+	CompactHalf     // HalfVertexData, 16 bytes
+};
+
+struct CompactVertexData {
+	float position[3];              // w = 1 is supplied by the attribute default
+	short normal[2];                // octahedral encoding, snorm16
+	unsigned short texcoord[2];     // unorm16
+};
+
+struct HalfVertexData {
+	unsigned short position[4];     // half floats, the 4th one only pads to 8 bytes
+	short normal[2];
+	unsigned short texcoord[2];
+};
+
+struct InstanceData {           // attributes 3-6, 7-10 and 11-14 of geom.vert, advanced per instance
+	mat4 ScaleRotate, Translate;
+	mat4 Normal;                // transpose(inverse(ScaleRotate))
+};
+
+// Instance attributes uploaded once and drawn every frame, e.g. the cells of a honeycomb.
+// Nothing is uploaded to a RenderBackend, those draw instances one by one.
+class InstanceBuffer {
+	unsigned int vbo = 0;
+	size_t count = 0;
+public:
+	InstanceBuffer() {}
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+	~InstanceBuffer();
+	void upload(const std::vector<InstanceData>& instances);
+	unsigned int getVbo() const { return vbo; }
+	size_t getCount() const { return count; }
+};
+
 class Geometry {
-protected:
-	unsigned int vao, vbo;        // vertex array object
 public:
-	Geometry();
-	virtual ~Geometry();
-	virtual void Draw() = 0;
-	void bindBuffer();
+	virtual ~Geometry() {}
+	virtual bool isReady() { return true; }                  // false while a ResourceLoader streams it
+	// Levels of detail, 0 is the coarsest. Errors and lengths are in modeling space.
+	virtual int nLevels() { return 1; }
+	virtual int defaultLevel() { return 0; }                  // drawn when the level is not selected
+	virtual float levelError(int level) { return 0.0f; }      // largest distance of the triangles from the surface
+	virtual float levelEdgeLength(int level) { return 0.0f; } // longest triangle edge
+	virtual VertexFormat levelFormat(int level) { return VertexFormat::Float; } // layout geom.vert has to decode
+	virtual unsigned int levelVertexArray(int level) { return 0; } // bound to draw the level, 0 if none
+	virtual float boundingRadius() = 0;                       // around the modeling space origin
+	virtual void boundingBox(vec3& min, vec3& max) = 0;       // in modeling space
+	virtual void Draw(int level = 0) = 0;
+	virtual void DrawInstanced(const std::vector<InstanceData>& instances, int level = 0) = 0;
+	virtual void DrawInstanced(const InstanceBuffer& instances, int level = 0) = 0;
+};
+
+// One tessellation of a ParamGeometry with its own buffers
+struct ParamMesh {
+	int N = 0, M = 0;
+	float error = 0.0f, edgeLength = 0.0f;
+	bool measured = false;
+	bool built = false;
+	VertexFormat format = VertexFormat::Float; // taken from ParamGeometry::vertexFormat when built
+	unsigned int vao = 0, vbo = 0;
+	unsigned int ibo = 0;
+	unsigned int instanceVbo = 0;
+	unsigned int instanceSource = 0; // buffer the instance attributes of the vao point into
+	unsigned int nIndices = 0;     // rows of the grid joined into one triangle strip
+	unsigned int indexType = 0;    // GL_UNSIGNED_SHORT when the grid fits, else GL_UNSIGNED_INT
+	unsigned int backendMesh = 0;  // handle of the mesh in the RenderBackend instead of the buffers
 };
 
 class ParamGeometry : public Geometry {
 protected:
-	unsigned int nVtxPerStrip, nStrips;
+	std::vector<ParamMesh> levels; // coarsest first
+	int tessellationLevelIndex = 0; // the level of tessellationLevel x tessellationLevel
+	float boundRadius;
+	vec3 boundMin, boundMax;
+	bool streaming = false;
+
+	template<class Store> void tessellate(int N, int M, const Store& store);
+	static std::vector<unsigned int> stripIndices(int N, int M);
+	static size_t vertexSize(VertexFormat format);
+	static void packVertex(const VertexData& vertex, VertexFormat format, unsigned char* destination);
+	static void setVertexAttributes(VertexFormat format);
+	// What measure finds out about a level: its error and edge length, and the bounds of its vertices
+	struct LevelMeasures {
+		float error, edgeLength, radius;
+		vec3 min, max;
+	};
+	LevelMeasures measure(int N, int M); // only evaluates the surface, so it may run on a loader thread
+	void setMeasures(ParamMesh& mesh, const LevelMeasures& measures);
+	void setBounds(const LevelMeasures& measures);
+	ParamMesh& measuredLevel(int level);
+	void build(ParamMesh& mesh);
+	void stage(const ParamMesh& mesh, VertexFormat format, std::vector<unsigned char>& bytes);
+	void upload(ParamMesh& mesh, VertexFormat format, const ResourceLoader::Staged& staged);
+	ParamMesh& mesh(int level);
+	void bindInstanceAttributes(ParamMesh& mesh, unsigned int buffer);
+	void uploadInstances(ParamMesh& mesh, const std::vector<InstanceData>& instances);
 public:
+	static VertexFormat vertexFormat; // for meshes tessellated from now on, built ones keep theirs
+	static unsigned int tessellationThreads; // 0 = one per core
+
 	ParamGeometry();
+	~ParamGeometry();
 	virtual void eval(Dnum2& U, Dnum2& V, Dnum2& X, Dnum2& Y, Dnum2& Z) = 0;
 	VertexData GenVertexData(float u, float v);
+	// a single level, tessellated right away
 	void create(int N = tessellationLevel, 
 				int M = tessellationLevel);
-	void Draw() override;
+	// N x N levels from coarsest to finest, spaced by sqrt(2) around tessellationLevel,
+	// which is one of them and the default. Tessellated on first use. Only the default level
+	// is measured now, for the bounds; the others when level selection first asks for their
+	// errors. With a ResourceLoader installed, the default level is measured and tessellated
+	// on its threads.
+	void createLevels(int coarsest, int finest);
+	bool isReady() override { return !streaming; }
+	int nLevels() override { return (int)levels.size(); }
+	int defaultLevel() override { return tessellationLevelIndex; }
+	float levelError(int level) override { return measuredLevel(level).error; }
+	float levelEdgeLength(int level) override { return measuredLevel(level).edgeLength; }
+	VertexFormat levelFormat(int level) override { return mesh(level).format; }
+	unsigned int levelVertexArray(int level) override { return mesh(level).vao; }
+	float boundingRadius() override { return boundRadius; }
+	void boundingBox(vec3& min, vec3& max) override { min = boundMin; max = boundMax; }
+	void Draw(int level = 0) override;
+	void DrawInstanced(const std::vector<InstanceData>& instances, int level = 0) override;
+	void DrawInstanced(const InstanceBuffer& instances, int level = 0) override;
 };
 
 #endif // GEOMETRY_H
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "glStateCache.h"
+#include <stdio.h>
+
+#ifdef __EMSCRIPTEN__
+#include <GLES3/gl3.h>
+#else
+#include <glad/glad.h>
+#endif
+
+namespace {
+
+const unsigned int unknown = ~0u; // binding not known, the next bind is made
+
+struct Bindings {
+	unsigned int program = unknown, activeUnit = unknown, vertexArray = unknown;
+	unsigned int textures[GLStateCache::maxTextureUnits]; // GL_TEXTURE_2D of each unit
+
+	Bindings() { for (unsigned int& texture : textures) texture = unknown; }
+};
+
+bool enabled = true;
+Bindings bound;
+GLStateCache::Counters frame, lastFrame;
+
+const char* const callNames[GLStateCache::CallCount] = { "program", "active texture", "texture", "vertex array", "uniform" };
+
+// true if the call has to be made, the cached value is updated
+bool change(unsigned int& cached, unsigned int value, GLStateCache::Call call) {
+	bool made = !enabled || cached != value;
+	cached = value;
+	GLStateCache::count(call, made);
+	return made;
+}
+
+} // namespace
+
+int GLStateCache::Counters::totalMade() const {
+	int total = 0;
+	for (int call = 0; call < CallCount; call++) total += made[call];
+	return total;
+}
+
+int GLStateCache::Counters::totalSkipped() const {
+	int total = 0;
+	for (int call = 0; call < CallCount; call++) total += skipped[call];
+	return total;
+}
+
+bool GLStateCache::isEnabled() {
+	return enabled;
+}
+
+void GLStateCache::setEnabled(bool enable) {
+	enabled = enable;
+	invalidate();
+}
+
+void GLStateCache::invalidate() {
+	bound = Bindings();
+}
+
+void GLStateCache::useProgram(unsigned int id) {
+	if (change(bound.program, id, UseProgram)) glUseProgram(id);
+}
+
+void GLStateCache::bindTexture(unsigned int unit, unsigned int texture) {
+	unsigned int uncached = unknown;
+	unsigned int& unitTexture = unit < maxTextureUnits ? bound.textures[unit] : uncached;
+	if (enabled && unitTexture == texture) { // the unit need not be active either
+		count(ActiveTexture, false);
+		count(BindTexture, false);
+		return;
+	}
+	if (change(bound.activeUnit, unit, ActiveTexture)) glActiveTexture(GL_TEXTURE0 + unit);
+	change(unitTexture, texture, BindTexture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLStateCache::bindTexture(unsigned int texture) {
+	if (bound.activeUnit == unknown) { // unit 0 then, to know which unit it goes to
+		bound.activeUnit = 0;
+		glActiveTexture(GL_TEXTURE0);
+		count(ActiveTexture, true);
+	}
+	bindTexture(bound.activeUnit, texture);
+}
+
+void GLStateCache::bindVertexArray(unsigned int id) {
+	if (change(bound.vertexArray, id, BindVertexArray)) glBindVertexArray(id);
+}
+
+void GLStateCache::count(Call call, bool made) {
+	if (made) frame.made[call]++;
+	else frame.skipped[call]++;
+}
+
+void GLStateCache::forgetProgram(unsigned int id) {
+	if (bound.program == id) bound.program = unknown;
+}
+
+void GLStateCache::forgetTexture(unsigned int texture) {
+	for (unsigned int& unitTexture : bound.textures) {
+		if (unitTexture == texture) unitTexture = 0;
+	}
+}
+
+void GLStateCache::forgetVertexArray(unsigned int id) {
+	if (bound.vertexArray == id) bound.vertexArray = 0;
+}
+
+void GLStateCache::endFrame() {
+	lastFrame = frame;
+	frame = Counters();
+}
+
+const GLStateCache::Counters& GLStateCache::getFrameCounters() {
+	return lastFrame;
+}
+
+void GLStateCache::printStats() {
+	printf("GL state calls in the last frame: %d made, %d skipped (", lastFrame.totalMade(), lastFrame.totalSkipped());
+	for (int call = 0; call < CallCount; call++) {
+		printf("%s%s %d of %d", call > 0 ? ", " : "", callNames[call], lastFrame.skipped[call],
+			   lastFrame.made[call] + lastFrame.skipped[call]);
+	}
+	printf(" skipped)\n");
+}
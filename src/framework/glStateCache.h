@@ -0,0 +1,47 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+// Remembers the program, the textures of the units and the vertex array bound, and leaves
+// out the binds that would not change them; GPUProgram does the same for the uniform
+// values of each program. Every bind of these has to go through here, or the cache would
+// not know what is bound: when GL state is changed around it, call invalidate().
+//
+// The calls made and left out are counted, the counts of the last frame are kept by
+// endFrame(). With the cache disabled every call is made, to compare.
+class GLStateCache {
+public:
+	enum Call { UseProgram, ActiveTexture, BindTexture, BindVertexArray, Uniform, CallCount };
+
+	struct Counters {
+		int made[CallCount] = {};
+		int skipped[CallCount] = {};
+
+		int totalMade() const;
+		int totalSkipped() const;
+	};
+
+	static const unsigned int maxTextureUnits = 16; // cached, the ones above are always bound
+
+	static bool isEnabled();
+	static void setEnabled(bool enable = true);
+	// Forgets everything bound, the next binds are made
+	static void invalidate();
+
+	static void useProgram(unsigned int program);
+	static void bindTexture(unsigned int unit, unsigned int texture); // GL_TEXTURE_2D
+	static void bindTexture(unsigned int texture);                    // to the active unit, e.g. to upload
+	static void bindVertexArray(unsigned int vertexArray);
+	// For the uniform setters, which compare the values themselves
+	static void count(Call call, bool made);
+
+	// Deleted objects are unbound by GL, and their names are given out again
+	static void forgetProgram(unsigned int program);
+	static void forgetTexture(unsigned int texture);
+	static void forgetVertexArray(unsigned int vertexArray);
+
+	static void endFrame();
+	static const Counters& getFrameCounters(); // of the last frame ended
+	static void printStats();
+};
+
+#endif // GL_STATE_CACHE_H
@@ -1,23 +1,60 @@
 #include "gpuProgram.h"
+#include "glStateCache.h"
+#include "profiler.h"
+#include "programCache.h"
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 
-void GPUProgram::getErrorInfo(unsigned int handle) {
+// GL_KHR_parallel_shader_compile, also in WebGL
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+std::vector<std::string> GPUProgram::handleNames;
+
+namespace {
+
+bool parallelShaderCompile() {
+	static int supported = -1;
+	if (supported < 0) {
+		supported = 0;
+		int nExtensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+		for (int i = 0; i < nExtensions; i++) {
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (name && (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ||
+						 strcmp(name, "GL_ARB_parallel_shader_compile") == 0)) supported = 1;
+		}
+	}
+	return supported == 1;
+}
+
+// unbound from the state cache, GL may give its name to the next program
+void deleteProgram(unsigned int program) {
+	GLStateCache::forgetProgram(program);
+	glDeleteProgram(program);
+}
+
+} // namespace
+
+void GPUProgram::getErrorInfo(unsigned int handle, bool wait) {
 	int logLen, written;
 	glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &logLen);
 	if (logLen > 0) {
 		std::string log(logLen, '\0');
 		glGetShaderInfoLog(handle, logLen, &written, &log[0]);
 		printf("Shader log:\n%s", log.c_str());
-		if (waitError) getchar();
+		if (wait) getchar();
 	}
 }
 
-bool GPUProgram::checkShader(unsigned int shader, std::string message) {
+bool GPUProgram::checkShader(unsigned int shader, std::string message, bool wait) {
 	int OK;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &OK);
 	if (!OK) {
 		printf("%s!\n", message.c_str());
-		getErrorInfo(shader);
+		getErrorInfo(shader, wait);
 		return false;
 	}
 	return true;
@@ -40,18 +77,104 @@ bool GPUProgram::checkLinking(unsigned int program) {
 	return true;
 }
 
+// Builds the name -> location table of the active uniforms of the linked program.
+void GPUProgram::reflectUniforms(int variant) {
+	unsigned int programId = variants[variant].programId;
+	std::unordered_map<std::string, int>& uniformLocations = variants[variant].uniformLocations;
+	uniformLocations.clear();
+	variants[variant].handleLocations.clear();
+	variants[variant].handleValues.clear();
+
+	int nUniforms = 0, maxLength = 0;
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &nUniforms);
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::string buffer(maxLength + 1, '\0');
+	for (int i = 0; i < nUniforms; i++) {
+		int length = 0, size = 0;
+		GLenum type;
+		glGetActiveUniform(programId, i, (GLsizei)buffer.size(), &length, &size, &type, &buffer[0]);
+		std::string name = buffer.substr(0, length);
+		int location = glGetUniformLocation(programId, name.c_str());
+		if (location < 0) continue; // uniform block member
+		uniformLocations[name] = location;
+
+		// arrays of basic types are reported once as "name[0]"
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+			std::string base = name.substr(0, name.size() - 3);
+			uniformLocations[base] = location;
+			for (int element = 1; element < size; element++) {
+				std::string elementName = base + "[" + std::to_string(element) + "]";
+				uniformLocations[elementName] = glGetUniformLocation(programId, elementName.c_str());
+			}
+		}
+	}
+}
+
 int GPUProgram::getLocation(const std::string& name) {
-	int location = glGetUniformLocation(shaderProgramId, name.c_str());
-	if (location < 0) printf("uniform %s cannot be set\n", name.c_str());
-	return location;
+	const std::unordered_map<std::string, int>& uniformLocations = variants[currentVariant].uniformLocations;
+	auto it = uniformLocations.find(name);
+	if (it == uniformLocations.end()) {
+		printf("uniform %s cannot be set\n", name.c_str());
+		return -1;
+	}
+	return it->second;
 }
 
-GPUProgram::GPUProgram(bool _waitError) {
+// Uniforms missing from this program (optimized out or not declared) resolve to -1 silently.
+int GPUProgram::getLocation(UniformHandle handle) {
+	if (handle.index < 0) return -1;
+	const std::unordered_map<std::string, int>& uniformLocations = variants[currentVariant].uniformLocations;
+	std::vector<int>& handleLocations = variants[currentVariant].handleLocations;
+	while ((int)handleLocations.size() <= handle.index) { // handles registered since the last lookup
+		auto it = uniformLocations.find(handleNames[handleLocations.size()]);
+		handleLocations.push_back(it != uniformLocations.end() ? it->second : -1);
+	}
+	return handleLocations[handle.index];
+}
+
+// Uniforms keep their values in the program, so a value set last time through the same
+// handle need not be set again
+bool GPUProgram::changed(UniformHandle handle, const void* value, size_t size) {
+	if (!GLStateCache::isEnabled()) {
+		GLStateCache::count(GLStateCache::Uniform, true);
+		return true;
+	}
+	std::vector<UniformValue>& values = variants[currentVariant].handleValues;
+	if ((int)values.size() <= handle.index) values.resize(handle.index + 1);
+	UniformValue& last = values[handle.index];
+	bool made = last.size != size || memcmp(last.data, value, size) != 0;
+	if (made) {
+		last.size = size;
+		memcpy(last.data, value, size);
+	}
+	GLStateCache::count(GLStateCache::Uniform, made);
+	return made;
+}
+
+void GPUProgram::forgetValues() {
+	variants[currentVariant].handleValues.clear();
+}
+
+UniformHandle GPUProgram::uniformHandle(const std::string& name) {
+	UniformHandle handle;
+	auto it = std::find(handleNames.begin(), handleNames.end(), name);
+	handle.index = (int)(it - handleNames.begin());
+	if (it == handleNames.end()) handleNames.push_back(name);
+	return handle;
+}
+
+GPUProgram::GPUProgram(bool _waitError) : variants(1) {
 	shaderProgramId = 0;
 	waitError = _waitError;
 }
 
-GPUProgram::GPUProgram(const GPUProgram& program) {
+void GPUProgram::setVariant(int variant) {
+	if ((int)variants.size() <= variant) variants.resize(variant + 1);
+	currentVariant = variant;
+	shaderProgramId = variants[variant].programId;
+}
+
+GPUProgram::GPUProgram(const GPUProgram& program) : variants(1) {
 	if (program.shaderProgramId > 0) printf("\nError: GPU program is not copied on GPU!!!\n");
 }
 
@@ -63,6 +186,22 @@ bool GPUProgram::create(const char* const vertexShaderSource,
 					   const char* const fragmentShaderSource,
 					   const char* const geometryShaderSource) 
 {
+	// Linked from the binary of an earlier run if the program cache has one
+	const char* const sources[] = { vertexShaderSource, fragmentShaderSource, geometryShaderSource };
+	uint64_t cacheKey = ProgramCache::key(sources, 3);
+	if (ProgramCache::isEnabled()) {
+		unsigned int program = glCreateProgram();
+		if (ProgramCache::load(program, cacheKey)) {
+			if (shaderProgramId > 0) deleteProgram(shaderProgramId);
+			shaderProgramId = variants[currentVariant].programId = program;
+			reflectUniforms(currentVariant);
+			GLStateCache::useProgram(shaderProgramId);
+			return true;
+		}
+		glDeleteProgram(program);
+	}
+	double compileStart = Profiler::now();
+
 	// Create vertex shader from string
 	if (vertexShader == 0) vertexShader = glCreateShader(GL_VERTEX_SHADER);
 	if (!vertexShader) {
@@ -71,7 +210,7 @@ bool GPUProgram::create(const char* const vertexShaderSource,
 	}
 	glShaderSource(vertexShader, 1, (const GLchar**)&vertexShaderSource, NULL);
 	glCompileShader(vertexShader);
-	if (!checkShader(vertexShader, "Vertex shader error")) return false;
+	if (!checkShader(vertexShader, "Vertex shader error", waitError)) return false;
 
 	// Create geometry shader from string if given
 #ifdef __EMSCRIPTEN__
@@ -89,7 +228,7 @@ bool GPUProgram::create(const char* const vertexShaderSource,
 		}
 		glShaderSource(geometryShader, 1, (const GLchar**)&geometryShaderSource, NULL);
 		glCompileShader(geometryShader);
-		if (!checkShader(geometryShader, "Geometry shader error")) return false;
+		if (!checkShader(geometryShader, "Geometry shader error", waitError)) return false;
 	}
 #endif
 
@@ -102,10 +241,11 @@ bool GPUProgram::create(const char* const vertexShaderSource,
 
 	glShaderSource(fragmentShader, 1, (const GLchar**)&fragmentShaderSource, NULL);
 	glCompileShader(fragmentShader);
-	if (!checkShader(fragmentShader, "Fragment shader error")) return false;
+	if (!checkShader(fragmentShader, "Fragment shader error", waitError)) return false;
 
-	// Attach shaders to program
-	shaderProgramId = glCreateProgram();
+	// Attach shaders to program, replacing the one linked into this variant before
+	if (shaderProgramId > 0) deleteProgram(shaderProgramId);
+	shaderProgramId = variants[currentVariant].programId = glCreateProgram();
 	if (!shaderProgramId) {
 		printf("Error in shader program creation\n");
 		exit(1);
@@ -118,57 +258,217 @@ bool GPUProgram::create(const char* const vertexShaderSource,
 #endif
 
 	// program packaging
+	ProgramCache::prepare(shaderProgramId);
 	glLinkProgram(shaderProgramId);
 	if (!checkLinking(shaderProgramId)) return false;
+	reflectUniforms(currentVariant);
+	if (ProgramCache::isEnabled()) {
+		ProgramCache::addCompileTime(Profiler::now() - compileStart);
+		ProgramCache::store(shaderProgramId, cacheKey);
+	}
 
 	// make this program run
-	glUseProgram(shaderProgramId);
+	GLStateCache::useProgram(shaderProgramId);
 	return true;
 }
 
+void GPUProgram::beginReload(int variant, const char* const vertexShaderSource, const char* const fragmentShaderSource) {
+	const char* const sources[] = { vertexShaderSource, fragmentShaderSource, nullptr };
+	PendingVariant reload;
+	reload.variant = variant;
+	reload.cacheKey = ProgramCache::key(sources, 3);
+
+	// no status queries here, they would wait for the compiler
+	reload.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(reload.vertexShader, 1, (const GLchar**)&vertexShaderSource, NULL);
+	glCompileShader(reload.vertexShader);
+	reload.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(reload.fragmentShader, 1, (const GLchar**)&fragmentShaderSource, NULL);
+	glCompileShader(reload.fragmentShader);
+
+	reload.programId = glCreateProgram();
+	glAttachShader(reload.programId, reload.vertexShader);
+	glAttachShader(reload.programId, reload.fragmentShader);
+#ifndef __EMSCRIPTEN__
+	glBindFragDataLocation(reload.programId, 0, "fragColor");
+#endif
+	ProgramCache::prepare(reload.programId);
+	glLinkProgram(reload.programId);
+	pending.push_back(reload);
+}
+
+bool GPUProgram::finishReload() {
+	if (pending.empty()) return true;
+	if (parallelShaderCompile()) {
+		for (const PendingVariant& reload : pending) {
+			int done = 0;
+			glGetProgramiv(reload.programId, GL_COMPLETION_STATUS_KHR, &done);
+			if (!done) return false;
+		}
+	}
+
+	bool linked = true;
+	for (const PendingVariant& reload : pending) {
+		linked = linked && checkShader(reload.vertexShader, "Vertex shader error", false) &&
+				 checkShader(reload.fragmentShader, "Fragment shader error", false) &&
+				 checkLinking(reload.programId);
+	}
+	if (!linked) {
+		printf("Shader reload failed, the running program is kept\n");
+		cancelReload();
+		return true;
+	}
+
+	for (const PendingVariant& reload : pending) {
+		glDeleteShader(reload.vertexShader); // freed with the program
+		glDeleteShader(reload.fragmentShader);
+		if ((int)variants.size() <= reload.variant) variants.resize(reload.variant + 1);
+		Variant& variant = variants[reload.variant];
+		if (variant.programId > 0) deleteProgram(variant.programId);
+		variant.programId = reload.programId;
+		reflectUniforms(reload.variant);
+		for (const auto& block : blockBindings) {
+			unsigned int blockIndex = glGetUniformBlockIndex(variant.programId, block.first.c_str());
+			if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(variant.programId, blockIndex, block.second);
+		}
+		ProgramCache::store(variant.programId, reload.cacheKey);
+	}
+	pending.clear();
+	shaderProgramId = variants[currentVariant].programId;
+	printf("Shader reloaded\n");
+	return true;
+}
+
+void GPUProgram::cancelReload() {
+	for (const PendingVariant& reload : pending) {
+		glDeleteShader(reload.vertexShader);
+		glDeleteShader(reload.fragmentShader);
+		glDeleteProgram(reload.programId);
+	}
+	pending.clear();
+}
+
 void GPUProgram::Use() {
-	glUseProgram(shaderProgramId);
+	GLStateCache::useProgram(shaderProgramId);
+}
+
+// in every variant
+void GPUProgram::bindUniformBlock(const std::string& blockName, unsigned int binding) {
+	auto bound = std::find_if(blockBindings.begin(), blockBindings.end(),
+							  [&](const std::pair<std::string, unsigned int>& b) { return b.first == blockName; });
+	if (bound == blockBindings.end()) blockBindings.emplace_back(blockName, binding);
+	else bound->second = binding;
+
+	for (const Variant& variant : variants) {
+		if (variant.programId == 0) continue;
+		unsigned int blockIndex = glGetUniformBlockIndex(variant.programId, blockName.c_str());
+		if (blockIndex == GL_INVALID_INDEX) {
+			printf("uniform block %s cannot be bound\n", blockName.c_str());
+			return;
+		}
+		glUniformBlockBinding(variant.programId, blockIndex, binding);
+	}
 }
 
 void GPUProgram::setUniform(int i, const std::string& name) {
 	int location = getLocation(name);
-	if (location >= 0) glUniform1i(location, i);
+	if (location >= 0) {
+		forgetValues(); // a handle may name the same uniform
+		glUniform1i(location, i);
+	}
 }
 
 void GPUProgram::setUniform(float f, const std::string& name) {
 	int location = getLocation(name);
-	if (location >= 0) glUniform1f(location, f);
+	if (location >= 0) {
+		forgetValues();
+		glUniform1f(location, f);
+	}
 }
 
 void GPUProgram::setUniform(const vec2& v, const std::string& name) {
 	int location = getLocation(name);
-	if (location >= 0) glUniform2fv(location, 1, &v.x);
+	if (location >= 0) {
+		forgetValues();
+		glUniform2fv(location, 1, &v.x);
+	}
 }
 
 void GPUProgram::setUniform(const vec3& v, const std::string& name) {
 	int location = getLocation(name);
-	if (location >= 0) glUniform3fv(location, 1, &v.x);
+	if (location >= 0) {
+		forgetValues();
+		glUniform3fv(location, 1, &v.x);
+	}
 }
 
 void GPUProgram::setUniform(const vec4& v, const std::string& name) {
 	int location = getLocation(name);
-	if (location >= 0) glUniform4fv(location, 1, &v.x);
+	if (location >= 0) {
+		forgetValues();
+		glUniform4fv(location, 1, &v.x);
+	}
 }
 
 void GPUProgram::setUniform(const mat4& mat, const std::string& name) {
 	int location = getLocation(name);
-	if (location >= 0) glUniformMatrix4fv(location, 1, GL_TRUE, mat);
+	if (location >= 0) {
+		forgetValues();
+		glUniformMatrix4fv(location, 1, GL_TRUE, mat);
+	}
 }
 
 void GPUProgram::setUniform(const Texture& texture, const std::string& samplerName, unsigned int textureUnit) {
 	int location = getLocation(samplerName);
 	if (location >= 0) {
+		forgetValues();
 		glUniform1i(location, textureUnit);
-		glActiveTexture(GL_TEXTURE0 + textureUnit);
-		glBindTexture(GL_TEXTURE_2D, texture.textureId);
+		GLStateCache::bindTexture(textureUnit, texture.textureId);
+	}
+}
+
+void GPUProgram::setUniform(int i, UniformHandle handle) {
+	int location = getLocation(handle);
+	if (location >= 0 && changed(handle, &i, sizeof(i))) glUniform1i(location, i);
+}
+
+void GPUProgram::setUniform(float f, UniformHandle handle) {
+	int location = getLocation(handle);
+	if (location >= 0 && changed(handle, &f, sizeof(f))) glUniform1f(location, f);
+}
+
+void GPUProgram::setUniform(const vec2& v, UniformHandle handle) {
+	int location = getLocation(handle);
+	if (location >= 0 && changed(handle, &v, sizeof(v))) glUniform2fv(location, 1, &v.x);
+}
+
+void GPUProgram::setUniform(const vec3& v, UniformHandle handle) {
+	int location = getLocation(handle);
+	if (location >= 0 && changed(handle, &v, sizeof(v))) glUniform3fv(location, 1, &v.x);
+}
+
+void GPUProgram::setUniform(const vec4& v, UniformHandle handle) {
+	int location = getLocation(handle);
+	if (location >= 0 && changed(handle, &v, sizeof(v))) glUniform4fv(location, 1, &v.x);
+}
+
+void GPUProgram::setUniform(const mat4& mat, UniformHandle handle) {
+	int location = getLocation(handle);
+	if (location >= 0 && changed(handle, &mat, sizeof(mat))) glUniformMatrix4fv(location, 1, GL_TRUE, mat);
+}
+
+void GPUProgram::setUniform(const Texture& texture, UniformHandle sampler, unsigned int textureUnit) {
+	int location = getLocation(sampler);
+	if (location >= 0) {
+		int unit = (int)textureUnit;
+		if (changed(sampler, &unit, sizeof(unit))) glUniform1i(location, unit);
+		GLStateCache::bindTexture(textureUnit, texture.textureId);
 	}
 }
 
 GPUProgram::~GPUProgram() {
-	if (shaderProgramId > 0) glDeleteProgram(shaderProgramId);
+	cancelReload();
+	for (const Variant& variant : variants) {
+		if (variant.programId > 0) deleteProgram(variant.programId);
+	}
 }
@@ -7,32 +7,88 @@
 #include <glad/glad.h>
 #endif
 
+#include <stdint.h>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "texture.h"
 
+// Uniform name resolved once, valid for every program: GPUProgram::uniformHandle("name")
+struct UniformHandle {
+    int index = -1;
+};
 
 class GPUProgram {
 private:
-    unsigned int shaderProgramId = 0;
+    // A uniform value as set, compared to leave out setting it again
+    struct UniformValue {
+        size_t size = 0; // 0: not set yet
+        float data[16];
+    };
+
+    // A program may be linked from several variants of its sources, e.g. with different
+    // #defines. Use() and the uniform setters work on the current one, see setVariant.
+    struct Variant {
+        unsigned int programId = 0;
+        std::unordered_map<std::string, int> uniformLocations; // active uniforms, filled at link time
+        std::vector<int> handleLocations;                      // location of each handle in this program
+        std::vector<UniformValue> handleValues;                // last set through each handle
+    };
+
+    // a variant being rebuilt by a reload
+    struct PendingVariant {
+        int variant;
+        unsigned int programId, vertexShader, fragmentShader;
+        uint64_t cacheKey;
+    };
+
+    std::vector<Variant> variants;
+    int currentVariant = 0;
+    unsigned int shaderProgramId = 0; // of the current variant
     unsigned int vertexShader = 0, geometryShader = 0, fragmentShader = 0;
     bool waitError = true;
+    std::vector<PendingVariant> pending;
+    std::vector<std::pair<std::string, unsigned int>> blockBindings; // applied again to reloaded programs
+
+    static std::vector<std::string> handleNames;
 
-    void getErrorInfo(unsigned int handle);
-    bool checkShader(unsigned int shader, std::string message);
+    void getErrorInfo(unsigned int handle, bool wait);
+    bool checkShader(unsigned int shader, std::string message, bool wait);
     bool checkLinking(unsigned int program);
+    void reflectUniforms(int variant);
     int getLocation(const std::string& name);
+    int getLocation(UniformHandle handle);
+    bool changed(UniformHandle handle, const void* value, size_t size); // false if the uniform already holds value
+    void forgetValues();                                                // of the handles, set by name instead
 
 public:
+    static UniformHandle uniformHandle(const std::string& name);
+
     GPUProgram(bool _waitError = true);
     GPUProgram(const GPUProgram& program);
     void operator=(const GPUProgram& program);
     unsigned int getId() { return shaderProgramId; }
 
+    // Makes the variant current, create() links into the current variant
+    void setVariant(int variant);
+    int getVariant() const { return currentVariant; }
+
     bool create(const char* const vertexShaderSource,
                 const char* const fragmentShaderSource,
                 const char* const geometryShaderSource = nullptr);
 
+    // Reloading while rendering: beginReload hands the new sources of a variant to the
+    // driver and returns, with KHR_parallel_shader_compile the driver compiles them on its
+    // own threads. finishReload, called once per frame, returns false until they are done,
+    // then replaces all the reloaded variants together if every one of them linked and keeps
+    // the running programs otherwise. Errors are printed, never waited on.
+    void beginReload(int variant, const char* const vertexShaderSource, const char* const fragmentShaderSource);
+    bool finishReload();
+    void cancelReload();
+
     void Use();
+    void bindUniformBlock(const std::string& blockName, unsigned int binding);
     void setUniform(int i, const std::string& name);
     void setUniform(float f, const std::string& name);
     void setUniform(const vec2& v, const std::string& name);
@@ -41,6 +97,14 @@ public:
     void setUniform(const mat4& mat, const std::string& name);
     void setUniform(const Texture& texture, const std::string& samplerName, unsigned int textureUnit = 0);
 
+    void setUniform(int i, UniformHandle handle);
+    void setUniform(float f, UniformHandle handle);
+    void setUniform(const vec2& v, UniformHandle handle);
+    void setUniform(const vec3& v, UniformHandle handle);
+    void setUniform(const vec4& v, UniformHandle handle);
+    void setUniform(const mat4& mat, UniformHandle handle);
+    void setUniform(const Texture& texture, UniformHandle sampler, unsigned int textureUnit = 0);
+
     ~GPUProgram();
 };
 
@@ -0,0 +1,62 @@
+#include "mappedFile.h"
+#include <stdio.h>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+#ifdef HAS_MMAP
+	int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0) return false;
+	struct stat status;
+	bool ok = fstat(file, &status) == 0;
+	if (ok && status.st_size > 0) {
+		void* mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		ok = mapping != MAP_FAILED;
+		if (ok) {
+			// read ahead, the loaders go through the file once from the start
+			madvise(mapping, (size_t)status.st_size, MADV_SEQUENTIAL);
+			bytes = (const unsigned char*)mapping;
+			length = (size_t)status.st_size;
+			mapped = true;
+		}
+	}
+	::close(file); // the mapping stays valid
+	return ok;
+#else
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) return false;
+	bool ok = fseek(file, 0, SEEK_END) == 0;
+	long end = ok ? ftell(file) : -1;
+	ok = end >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	if (ok) {
+		contents.resize((size_t)end);
+		ok = fread(contents.data(), 1, contents.size(), file) == contents.size();
+	}
+	fclose(file);
+	if (!ok) contents.clear();
+	bytes = contents.data();
+	length = contents.size();
+	return ok;
+#endif
+}
+
+void MappedFile::close() {
+#ifdef HAS_MMAP
+	if (mapped) munmap((void*)bytes, length);
+#endif
+	mapped = false;
+	bytes = nullptr;
+	length = 0;
+	contents.clear();
+}
@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// A file read only, mapped into memory where there is mmap, so its bytes are used where
+// they are instead of being copied into buffers first; the pages are read in by the
+// kernel as they are touched. Elsewhere, on Windows and the web, the file is read whole.
+class MappedFile {
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+	bool mapped = false;
+	std::vector<unsigned char> contents; // without mmap
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	void operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	// false if the file cannot be opened, an empty file opens with size 0
+	bool open(const std::string& path);
+	void close();
+
+	const unsigned char* data() const { return bytes; }
+	size_t size() const { return length; }
+};
+
+#endif // MAPPED_FILE_H
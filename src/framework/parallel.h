@@ -0,0 +1,116 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline unsigned int hardwareThreadCount() {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+	return 1;
+#else
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+#endif
+}
+
+// Worker threads shared by every parallelFor, started when first needed and kept
+// until exit. The calling thread works on its own loop as well, so nested and
+// concurrent loops finish even when all workers are busy elsewhere.
+class ThreadPool {
+	struct Job {
+		int count;
+		const void* func;
+		void (*call)(const void* func, int i);
+		std::atomic<int> next{ 0 };
+		unsigned int helpers; // workers that may still join, guarded by mutex
+		unsigned int active;  // workers on it right now, guarded by mutex
+	};
+
+	std::mutex mutex;
+	std::condition_variable jobQueued, helperDone;
+	std::deque<Job*> jobs;
+	std::vector<std::thread> workers;
+	bool stopping = false;
+
+	static void work(Job& job) {
+		for (int i = job.next++; i < job.count; i = job.next++) job.call(job.func, i);
+	}
+
+	void workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			jobQueued.wait(lock, [&]() { return stopping || !jobs.empty(); });
+			if (stopping) return;
+			Job* job = jobs.front();
+			if (--job->helpers == 0) jobs.pop_front();
+			job->active++;
+			lock.unlock();
+			work(*job);
+			lock.lock();
+			if (--job->active == 0) helperDone.notify_all();
+		}
+	}
+
+	ThreadPool() {}
+public:
+	static ThreadPool& shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobQueued.notify_all();
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	unsigned int workerCount() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return (unsigned int)workers.size();
+	}
+
+	// Runs func(i) for i in [0, count) on the calling thread and up to nHelpers workers
+	template<class Func> void run(int count, const Func& func, unsigned int nHelpers) {
+		Job job;
+		job.count = count;
+		job.func = &func;
+		job.call = [](const void* f, int i) { (*(const Func*)f)(i); };
+		job.helpers = nHelpers;
+		job.active = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (workers.size() < nHelpers) workers.emplace_back([this]() { workerLoop(); });
+			jobs.push_back(&job);
+		}
+		jobQueued.notify_all();
+		work(job);
+
+		// once the caller runs out of items, no further worker may join
+		std::unique_lock<std::mutex> lock(mutex);
+		if (job.helpers > 0) jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+		helperDone.wait(lock, [&]() { return job.active == 0; });
+	}
+};
+
+// Calls func(i) for every i in [0, count) on nThreads threads (0 = one per core).
+// Items are handed out one by one, so func should do a reasonable chunk of work.
+template<class Func>
+void parallelFor(int count, const Func& func, unsigned int nThreads = 0) {
+	if (nThreads == 0) nThreads = hardwareThreadCount();
+	if (nThreads > (unsigned int)count) nThreads = count > 0 ? count : 1;
+	if (nThreads <= 1) {
+		for (int i = 0; i < count; i++) func(i);
+		return;
+	}
+	ThreadPool::shared().run(count, func, nThreads - 1);
+}
+
+#endif // PARALLEL_H
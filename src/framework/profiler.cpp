@@ -0,0 +1,213 @@
+#include "profiler.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#ifdef __EMSCRIPTEN__
+#include <GLES3/gl3.h>
+#else
+#include <glad/glad.h>
+#endif
+
+std::atomic<bool> Profiler::enabled(false);
+std::vector<ProfileFrame> Profiler::frames(Profiler::defaultHistorySize);
+int Profiler::frameIndex = 0;
+
+namespace {
+
+std::mutex mutex;
+const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+std::atomic<int> threadCount(0);
+thread_local int threadNumber = -1;
+
+int currentThread() {
+	if (threadNumber < 0) threadNumber = threadCount++;
+	return threadNumber;
+}
+
+// GL timestamp queries are only issued on the thread that enabled them
+bool gpuTimers = false;
+std::thread::id gpuThread;
+double gpuClockOffset = 0;          // cpu seconds - gpu seconds
+std::vector<unsigned int> freeQueries;
+
+// results are read back this many frames after they were issued
+const int gpuLatency = 3;
+
+bool timeOnGpu() {
+	return gpuTimers && std::this_thread::get_id() == gpuThread;
+}
+
+unsigned int issueTimestamp() {
+#ifdef __EMSCRIPTEN__
+	return 0;
+#else
+	unsigned int query;
+	if (freeQueries.empty()) {
+		glGenQueries(1, &query);
+	}
+	else {
+		query = freeQueries.back();
+		freeQueries.pop_back();
+	}
+	glQueryCounter(query, GL_TIMESTAMP);
+	return query;
+#endif
+}
+
+} // namespace
+
+double Profiler::now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Profiler::setEnabled(bool enable) {
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Profiler::setHistorySize(int nFrames) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (timeOnGpu()) {
+		for (ProfileFrame& frame : frames) resolveGpuEvents(frame, true);
+	}
+	frames = std::vector<ProfileFrame>(nFrames > 1 ? nFrames : 1);
+}
+
+void Profiler::enableGpuTimers(bool enable) {
+#ifndef __EMSCRIPTEN__
+	std::lock_guard<std::mutex> lock(mutex);
+	gpuTimers = enable;
+	gpuThread = std::this_thread::get_id();
+	if (enable) {
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuClockOffset = now() - gpuNow * 1e-9;
+	}
+#endif
+}
+
+ProfileFrame& Profiler::currentFrame() {
+	return frames[frameIndex % frames.size()];
+}
+
+// Turns the timestamp pairs of the frame into GPU events once the results are
+// available (or right away with wait) and recycles the queries.
+void Profiler::resolveGpuEvents(ProfileFrame& frame, bool wait) {
+#ifndef __EMSCRIPTEN__
+	size_t nEvents = frame.events.size();
+	for (size_t i = 0; i < nEvents; i++) {
+		ProfileEvent& event = frame.events[i];
+		if (event.gpuQueries[1] == 0) continue;
+
+		GLint available = 1;
+		if (!wait) glGetQueryObjectiv(event.gpuQueries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(event.gpuQueries[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(event.gpuQueries[1], GL_QUERY_RESULT, &end);
+		freeQueries.push_back(event.gpuQueries[0]);
+		freeQueries.push_back(event.gpuQueries[1]);
+		event.gpuQueries[0] = event.gpuQueries[1] = 0;
+
+		ProfileEvent gpuEvent;
+		gpuEvent.name = event.name;
+		gpuEvent.start = begin * 1e-9 + gpuClockOffset;
+		gpuEvent.duration = (end - begin) * 1e-9;
+		gpuEvent.thread = -1;
+		gpuEvent.gpuQueries[0] = gpuEvent.gpuQueries[1] = 0;
+		frame.events.push_back(gpuEvent);
+	}
+#endif
+}
+
+void Profiler::beginFrame() {
+	std::lock_guard<std::mutex> lock(mutex);
+	frameIndex++;
+	if (timeOnGpu() && frameIndex >= gpuLatency) {
+		resolveGpuEvents(frames[(frameIndex - gpuLatency) % frames.size()], false);
+	}
+	ProfileFrame& frame = currentFrame();
+	if (timeOnGpu()) resolveGpuEvents(frame, true); // the slot is about to be reused
+	frame.index = frameIndex;
+	frame.start = now();
+	frame.duration = 0;
+	frame.events.clear();
+}
+
+void Profiler::endFrame() {
+	std::lock_guard<std::mutex> lock(mutex);
+	ProfileFrame& frame = currentFrame();
+	frame.duration = now() - frame.start;
+}
+
+int Profiler::beginZone(const char* name, int& frame) {
+	ProfileEvent event;
+	event.name = name;
+	event.thread = currentThread();
+	event.duration = 0;
+	event.gpuQueries[0] = event.gpuQueries[1] = 0;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (timeOnGpu()) event.gpuQueries[0] = issueTimestamp();
+	event.start = now();
+	ProfileFrame& current = currentFrame();
+	if (current.index != frameIndex) { // zones before the first beginFrame
+		current.index = frameIndex;
+		current.start = event.start;
+		current.events.clear();
+	}
+	frame = frameIndex;
+	current.events.push_back(event);
+	return (int)current.events.size() - 1;
+}
+
+void Profiler::endZone(int frame, int zone) {
+	double end = now();
+	std::lock_guard<std::mutex> lock(mutex);
+	ProfileFrame& owner = frames[frame % frames.size()];
+	if (owner.index != frame) return; // overwritten meanwhile
+	ProfileEvent& event = owner.events[zone];
+	event.duration = end - event.start;
+	if (event.gpuQueries[0] != 0) event.gpuQueries[1] = issueTimestamp();
+}
+
+const ProfileFrame* Profiler::getFrame(int framesAgo) {
+	int index = frameIndex - 1 - framesAgo;
+	if (framesAgo < 0 || index < 0 || framesAgo >= (int)frames.size() - 1) return nullptr;
+	const ProfileFrame& frame = frames[index % frames.size()];
+	return frame.index == index ? &frame : nullptr;
+}
+
+// Writes the frames in the ring buffer as a Chrome trace (chrome://tracing, Perfetto).
+bool Profiler::exportChromeTrace(const std::string& path) {
+	std::lock_guard<std::mutex> lock(mutex);
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) {
+		printf("Cannot open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":-1,\"args\":{\"name\":\"GPU\"}}");
+	int nFrames = (int)frames.size();
+	for (int i = frameIndex - nFrames + 1; i <= frameIndex; i++) {
+		if (i < 0) continue;
+		const ProfileFrame& frame = frames[i % nFrames];
+		if (frame.index != i) continue;
+		if (frame.duration > 0) {
+			fprintf(file, ",\n{\"name\":\"Frame %d\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":0}",
+				i, frame.start * 1e6, frame.duration * 1e6);
+		}
+		for (const ProfileEvent& event : frame.events) {
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+				event.name, event.start * 1e6, event.duration * 1e6, event.thread);
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
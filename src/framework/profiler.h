@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+struct ProfileEvent {
+	const char* name;
+	double start, duration;     // seconds since the profiler started
+	int thread;                 // numbered in order of first use, GPU events use -1
+	unsigned int gpuQueries[2]; // GL timestamp queries, 0 when not timed on the GPU
+};
+
+struct ProfileFrame {
+	int index = -1;
+	double start = 0, duration = 0;
+	std::vector<ProfileEvent> events;
+};
+
+// Scoped-timer instrumentation. Zones are recorded into the current frame and
+// the last historySize frames are kept in a ring buffer. On desktop GL builds,
+// zones opened on the GL thread are also timed with GL timestamp queries once
+// enableGpuTimers() was called; their results are read back a few frames later.
+// Zones are only recorded while the profiler is enabled, otherwise a zone costs
+// one atomic load. Without ENABLE_PROFILER, PROFILE_ZONE compiles to nothing.
+class Profiler {
+	static std::atomic<bool> enabled;
+	static std::vector<ProfileFrame> frames;
+	static int frameIndex;
+
+	static ProfileFrame& currentFrame();
+	static void resolveGpuEvents(ProfileFrame& frame, bool wait);
+
+public:
+	static const int defaultHistorySize = 120;
+
+	static double now();
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+	static void setEnabled(bool enable = true);
+	static void setHistorySize(int nFrames);
+	static void enableGpuTimers(bool enable = true); // needs a current GL context
+
+	static void beginFrame();
+	static void endFrame();
+	static int beginZone(const char* name, int& frame);
+	static void endZone(int frame, int zone);
+
+	static const ProfileFrame* getFrame(int framesAgo); // 0 is the last finished frame
+	static bool exportChromeTrace(const std::string& path);
+};
+
+class ProfileZone {
+	int frame, zone = -1;
+public:
+	ProfileZone(const char* name) { if (Profiler::isEnabled()) zone = Profiler::beginZone(name, frame); }
+	~ProfileZone() { if (zone >= 0) Profiler::endZone(frame, zone); }
+};
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,200 @@
+#include "programCache.h"
+#include "profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+#include <vector>
+
+#ifdef __EMSCRIPTEN__
+#include <GLES3/gl3.h>
+#else
+#include <glad/glad.h>
+#endif
+
+// GL 4.1 / ARB_get_program_binary, missing from the 3.3 core loader
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace {
+
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+GetProgramBinaryProc getProgramBinary = nullptr;
+ProgramBinaryProc programBinary = nullptr;
+ProgramParameteriProc programParameteri = nullptr;
+
+std::string cacheDirectory;
+uint64_t driverHash = 0;
+ProgramCache::Stats stats;
+
+// Layout of a cache file, followed by the binary
+struct EntryHeader {
+	char     magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+	uint64_t checksum;          // of the binary
+};
+const char entryMagic[4] = { 'N', 'E', 'P', 'C' };
+const uint32_t entryVersion = 1;
+
+// FNV-1a
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string entryPath(uint64_t key) {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return cacheDirectory + "/" + name;
+}
+
+} // namespace
+
+bool ProgramCache::enable(const std::string& directory, void* (*getProcAddress)(const char* name)) {
+#ifdef __EMSCRIPTEN__
+	return false;
+#else
+	getProgramBinary = (GetProgramBinaryProc)getProcAddress("glGetProgramBinary");
+	programBinary = (ProgramBinaryProc)getProcAddress("glProgramBinary");
+	programParameteri = (ProgramParameteriProc)getProcAddress("glProgramParameteri");
+	int formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	glGetError(); // an invalid enum before 4.1
+	if (!getProgramBinary || !programBinary || !programParameteri || formats <= 0) {
+		printf("Program binaries are not supported, shaders are compiled on every start\n");
+		getProgramBinary = nullptr;
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	if (error) {
+		printf("Cannot create the program cache %s\n", directory.c_str());
+		getProgramBinary = nullptr;
+		return false;
+	}
+	cacheDirectory = directory;
+
+	driverHash = hashBytes(&entryVersion, sizeof(entryVersion));
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const char* value = (const char*)glGetString(name);
+		if (value) driverHash = hashBytes(value, strlen(value) + 1, driverHash);
+	}
+	return true;
+#endif
+}
+
+bool ProgramCache::isEnabled() {
+	return getProgramBinary != nullptr;
+}
+
+uint64_t ProgramCache::key(const char* const sources[], int count) {
+	uint64_t hash = driverHash;
+	for (int i = 0; i < count; i++) {
+		size_t length = sources[i] ? strlen(sources[i]) : 0;
+		hash = hashBytes(&length, sizeof(length), hash); // so sources do not run into each other
+		hash = hashBytes(sources[i], length, hash);
+	}
+	return hash;
+}
+
+bool ProgramCache::load(unsigned int program, uint64_t key) {
+	if (!isEnabled()) return false;
+	PROFILE_ZONE("ProgramCache::load");
+	double start = Profiler::now();
+
+	FILE* file = fopen(entryPath(key).c_str(), "rb");
+	if (!file) {
+		stats.misses++;
+		return false;
+	}
+	EntryHeader header;
+	std::vector<unsigned char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+				 memcmp(header.magic, entryMagic, sizeof(entryMagic)) == 0 &&
+				 header.version == entryVersion && header.key == key && header.length > 0;
+	if (valid) {
+		binary.resize(header.length);
+		valid = fread(binary.data(), 1, binary.size(), file) == binary.size() &&
+				hashBytes(binary.data(), binary.size()) == header.checksum;
+	}
+	fclose(file);
+
+	int linked = 0;
+	if (valid) {
+		programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	}
+	if (!linked) {
+		// the caller compiles the sources and overwrites the entry
+		printf("Program cache entry %016llx is invalid, compiling\n", (unsigned long long)key);
+		stats.rejected++;
+		stats.misses++;
+		return false;
+	}
+	stats.hits++;
+	stats.loadSeconds += Profiler::now() - start;
+	return true;
+}
+
+void ProgramCache::prepare(unsigned int program) {
+	if (isEnabled()) programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(unsigned int program, uint64_t key) {
+	if (!isEnabled()) return;
+	PROFILE_ZONE("ProgramCache::store");
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	EntryHeader header;
+	memcpy(header.magic, entryMagic, sizeof(entryMagic));
+	header.version = entryVersion;
+	header.key = key;
+	std::vector<unsigned char> binary(length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	getProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0) return;
+	header.format = format;
+	header.length = (uint32_t)written;
+	header.checksum = hashBytes(binary.data(), written);
+
+	// written next to the entry and renamed, a concurrent reader sees all or nothing
+	std::string path = entryPath(key), temporary = path + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) return;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			  fwrite(binary.data(), 1, written, file) == (size_t)written;
+	ok = fclose(file) == 0 && ok;
+	std::error_code error;
+	if (ok) std::filesystem::rename(temporary, path, error);
+	if (!ok || error) std::filesystem::remove(temporary, error);
+}
+
+void ProgramCache::addCompileTime(double seconds) {
+	stats.compileSeconds += seconds;
+}
+
+const ProgramCache::Stats& ProgramCache::getStats() {
+	return stats;
+}
+
+void ProgramCache::printStats() {
+	if (!isEnabled()) return;
+	printf("Program cache: %d hits (%.1f ms), %d misses (%.1f ms compiling), %d rejected\n",
+		   stats.hits, stats.loadSeconds * 1000, stats.misses, stats.compileSeconds * 1000, stats.rejected);
+}
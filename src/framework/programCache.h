@@ -0,0 +1,38 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <stdint.h>
+#include <string>
+
+// On-disk cache of linked programs (glGetProgramBinary / glProgramBinary, core since GL
+// 4.1). A program is stored under a hash of its sources, the #defines included, and of the
+// GL vendor, renderer and version strings, so a driver update misses instead of loading a
+// stale binary. Entries are checked for size and checksum, and a binary the driver refuses
+// to link is compiled from source again and overwritten. GPUProgram::create goes through
+// the cache once enable() succeeded; it never does on WebGL, which has no program binaries.
+class ProgramCache {
+public:
+	struct Stats {
+		int hits = 0, misses = 0, rejected = 0; // rejected: found but invalid or refused by the driver
+		double loadSeconds = 0, compileSeconds = 0;
+	};
+
+	// The entry points are looked up at run time with getProcAddress, as the context may be
+	// older than 4.1. Call with a current context, false if the driver has no binary format.
+	static bool enable(const std::string& directory, void* (*getProcAddress)(const char* name));
+	static bool isEnabled();
+
+	static uint64_t key(const char* const sources[], int count);
+	// Links program from the entry of key, false if there is none or it does not link
+	static bool load(unsigned int program, uint64_t key);
+	// Marks program, before it is linked, to have its binary retrievable
+	static void prepare(unsigned int program);
+	static void store(unsigned int program, uint64_t key);
+	// Time spent compiling the programs that missed, for the stats
+	static void addCompileTime(double seconds);
+
+	static const Stats& getStats();
+	static void printStats();
+};
+
+#endif // PROGRAM_CACHE_H
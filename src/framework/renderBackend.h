@@ -0,0 +1,30 @@
+#ifndef RENDER_BACKEND_H
+#define RENDER_BACKEND_H
+
+#include <vector>
+#include "geometry.h"
+
+struct RenderState;
+
+// Renders without a GL context, e.g. on the CPU. While a backend is installed the
+// framework classes create no GL objects, they hand their data and draws over here
+// and keep the returned handles instead of GL names.
+class RenderBackend {
+	static inline RenderBackend* installed = nullptr;
+public:
+	static RenderBackend* get() { return installed; } // nullptr: rendering with GL
+	static void install(RenderBackend* backend) { installed = backend; }
+	virtual ~RenderBackend() {}
+
+	virtual unsigned int createMesh(std::vector<VertexData>&& vertices, std::vector<unsigned int>&& indices) = 0;
+	virtual void deleteMesh(unsigned int mesh) = 0;
+	virtual unsigned int createTexture(int width, int height, const std::vector<vec4>& image, int sampling) = 0;
+	virtual void deleteTexture(unsigned int texture) = 0;
+
+	// what the shaders get for the next draws: transformations, lights, material and texture
+	virtual void bind(const RenderState& state) = 0;
+	// triangle strip of the mesh, degenerate triangles join its rows
+	virtual void drawMesh(unsigned int mesh, unsigned int nIndices) = 0;
+};
+
+#endif // RENDER_BACKEND_H
@@ -0,0 +1,226 @@
+#include "resourceLoader.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __EMSCRIPTEN__
+#include <GLES3/gl3.h>
+#else
+#include <glad/glad.h>
+#endif
+
+// GL 4.4 / ARB_buffer_storage, missing from the 3.3 core loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace {
+
+#ifndef __EMSCRIPTEN__
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+#endif
+
+const size_t stagingAlignment = 256; // of the uploads in the ring
+const unsigned int maxLoaderThreads = 4;
+
+} // namespace
+
+void ResourceLoader::Staged::copyTo(unsigned int target, size_t from, size_t size, size_t to) const {
+	if (buffer) glCopyBufferSubData(GL_COPY_READ_BUFFER, target, offset + from, to, size);
+	else glBufferSubData(target, to, size, data + from);
+}
+
+ResourceLoader::ResourceLoader(void* (*getProcAddress)(const char* name)) {
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+	unsigned int nThreads = std::min(maxLoaderThreads, std::max(1u, hardwareThreadCount() - 1));
+	for (unsigned int i = 0; i < nThreads; i++) workers.emplace_back([this]() { workerLoop(); });
+#endif
+#ifndef __EMSCRIPTEN__
+	glGenBuffers(1, &ring);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+	BufferStorageProc bufferStorage = getProcAddress ? (BufferStorageProc)getProcAddress("glBufferStorage") : nullptr;
+	if (bufferStorage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		bufferStorage(GL_COPY_WRITE_BUFFER, ringSize, nullptr, flags);
+		persistent = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, ringSize, flags);
+		if (!persistent) glGetError(); // the entry point without the extension, mapped for each upload below
+	}
+	if (!persistent) {
+		glDeleteBuffers(1, &ring); // immutable if the storage was made
+		glGenBuffers(1, &ring);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+		glBufferData(GL_COPY_WRITE_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+#endif
+}
+
+ResourceLoader::~ResourceLoader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queued.notify_all();
+	for (std::thread& worker : workers) worker.join();
+	if (installed == this) installed = nullptr;
+#ifndef __EMSCRIPTEN__
+	for (const Region& region : inFlight) glDeleteSync((GLsync)region.fence);
+	if (ring > 0) {
+		if (persistent) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		}
+		glDeleteBuffers(1, &ring);
+	}
+#endif
+}
+
+void ResourceLoader::add(Load load, Upload upload) {
+	std::unique_ptr<Job> job(new Job{ std::move(load), std::move(upload), {} });
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		waiting.push_back(std::move(job));
+		stats.queued++;
+	}
+	queued.notify_one();
+}
+
+void ResourceLoader::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		queued.wait(lock, [&]() { return stopping || !waiting.empty(); });
+		if (stopping) return;
+		std::unique_ptr<Job> job = std::move(waiting.front());
+		waiting.pop_front();
+		loading++;
+		lock.unlock();
+		job->load(job->bytes);
+		lock.lock();
+		loading--;
+		finished.push_back(std::move(job));
+		loaded.notify_all();
+	}
+}
+
+void ResourceLoader::update(size_t budget) {
+	PROFILE_ZONE("ResourceLoader::update");
+	retire(false);
+	size_t uploaded = 0;
+	while (uploaded < budget) {
+		std::unique_ptr<Job> job;
+		bool load = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!finished.empty()) {
+				job = std::move(finished.front());
+				finished.pop_front();
+			}
+			else if (workers.empty() && !waiting.empty()) { // no threads, loaded here
+				job = std::move(waiting.front());
+				waiting.pop_front();
+				load = true;
+			}
+		}
+		if (!job) return;
+		if (load) job->load(job->bytes);
+		if (!upload(*job)) {
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.push_front(std::move(job));
+			return;
+		}
+		uploaded += std::max(job->bytes.size(), (size_t)1);
+	}
+}
+
+void ResourceLoader::finish() {
+	PROFILE_ZONE("ResourceLoader::finish");
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!workers.empty()) loaded.wait(lock, [&]() { return !finished.empty() || (waiting.empty() && loading == 0); });
+			if (finished.empty() && waiting.empty() && loading == 0) return;
+		}
+		retire(true); // frees the ring for what is left
+		update(SIZE_MAX);
+	}
+}
+
+bool ResourceLoader::isIdle() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return waiting.empty() && finished.empty() && loading == 0;
+}
+
+bool ResourceLoader::upload(Job& job) {
+	Staged staged;
+	staged.size = job.bytes.size();
+	staged.data = job.bytes.data();
+	bool staging = ring > 0 && staged.size <= ringSize; // larger ones go from client memory
+	size_t offset = staging ? allocate(staged.size) : ringSize;
+	if (staging && offset == ringSize) return false; // the ring is busy, next frame
+
+#ifndef __EMSCRIPTEN__
+	if (staging) {
+		if (persistent) {
+			memcpy(persistent + offset, staged.data, staged.size);
+		}
+		else if (staged.size > 0) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ring);
+			// the fences keep GL off this part, it need not wait for anything
+			void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, staged.size,
+			                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (mapped) memcpy(mapped, staged.data, staged.size);
+			if (!mapped || !glUnmapBuffer(GL_COPY_WRITE_BUFFER)) glBufferSubData(GL_COPY_WRITE_BUFFER, offset, staged.size, staged.data);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		staged.buffer = ring;
+		staged.offset = offset;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+		glBindBuffer(GL_COPY_READ_BUFFER, ring);
+	}
+#endif
+	job.upload(staged);
+#ifndef __EMSCRIPTEN__
+	if (staged.buffer) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		Region region = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), offset };
+		inFlight.push_back(region);
+		stats.stagedBytes += staged.size;
+	}
+#endif
+	stats.uploaded++;
+	stats.uploadedBytes += staged.size;
+	return true;
+}
+
+// The ring is used in order: the free part runs from head to the oldest region in flight,
+// wrapping around its end. head == the oldest begin with regions in flight means full.
+size_t ResourceLoader::allocate(size_t size) {
+	size = std::max((size + stagingAlignment - 1) / stagingAlignment * stagingAlignment, stagingAlignment);
+	if (inFlight.empty()) head = 0;
+	size_t tail = inFlight.empty() ? ringSize : inFlight.front().begin;
+	size_t offset = ringSize;
+	if (head < tail || inFlight.empty()) {
+		if (head + size <= tail) offset = head;
+	}
+	else if (head > tail) {
+		if (head + size <= ringSize) offset = head;
+		else if (size <= tail) offset = 0;
+	}
+	if (offset < ringSize) head = offset + size;
+	return offset;
+}
+
+void ResourceLoader::retire(bool wait) {
+#ifndef __EMSCRIPTEN__
+	while (!inFlight.empty()) {
+		GLsync fence = (GLsync)inFlight.front().fence;
+		GLenum status = glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+		if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) return;
+		glDeleteSync(fence);
+		inFlight.pop_front();
+	}
+#endif
+}
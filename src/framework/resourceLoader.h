@@ -0,0 +1,106 @@
+#ifndef RESOURCE_LOADER_H
+#define RESOURCE_LOADER_H
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Creates textures and meshes without blocking the frame loop. The CPU work of a job,
+// decoding or tessellating, runs on a loader thread into memory of its own; update(),
+// called once a frame on the GL thread, uploads the finished jobs until a byte budget is
+// spent, so the scene shows up piece by piece instead of after a long Build.
+//
+// Uploads go through a staging ring buffer: the bytes are copied into it and GL copies them
+// on to the texture or buffer from there, without the driver waiting on the copy. Each
+// upload is fenced and its part of the ring is only written again once the fence signals;
+// when the ring is full, the rest waits for the next frame instead of stalling. The ring is
+// mapped once for good where glBufferStorage exists (GL 4.4 / ARB_buffer_storage), the
+// part written is mapped for each upload otherwise. WebGL cannot map buffers, and without
+// threads the jobs are loaded in update(); there uploads are made from the job's memory.
+//
+// While a loader is installed, Texture and ParamGeometry stream through it and report
+// isReady() once uploaded. They have to outlive their jobs.
+class ResourceLoader {
+public:
+	// Where an upload reads the bytes of its job from
+	struct Staged {
+		unsigned int buffer = 0; // the ring, bound to GL_PIXEL_UNPACK_BUFFER and GL_COPY_READ_BUFFER, 0: client memory
+		size_t offset = 0;       // in the ring
+		const unsigned char* data = nullptr; // client memory
+		size_t size = 0;
+
+		// the pixels argument of glTex(Sub)Image2D for the bytes from offset from on
+		const void* pixels(size_t from) const { return buffer ? (const void*)(offset + from) : (const void*)(data + from); }
+		// into the buffer bound to target, at offset to
+		void copyTo(unsigned int target, size_t from, size_t size, size_t to) const;
+	};
+
+	struct Stats {
+		int queued = 0, uploaded = 0;
+		size_t uploadedBytes = 0, stagedBytes = 0; // stagedBytes: through the ring
+	};
+
+	// load fills the bytes on a loader thread, upload sends them to GL in update()
+	typedef std::function<void(std::vector<unsigned char>& bytes)> Load;
+	typedef std::function<void(const Staged& staged)> Upload;
+
+	static const size_t frameBudget = 4 << 20;  // bytes uploaded per frame by default
+	static const size_t ringSize = 16 << 20;
+
+	// With a current context; getProcAddress looks up glBufferStorage, which the 3.3 loader lacks
+	explicit ResourceLoader(void* (*getProcAddress)(const char* name) = nullptr);
+	ResourceLoader(const ResourceLoader&) = delete;
+	void operator=(const ResourceLoader&) = delete;
+	~ResourceLoader();
+
+	static ResourceLoader* get() { return installed; } // nullptr: resources are created right away
+	static void install(ResourceLoader* loader) { installed = loader; }
+
+	void add(Load load, Upload upload);
+	// On the GL thread, once a frame. Uploads at least one finished job if there is any.
+	void update(size_t budget = frameBudget);
+	// Loads and uploads everything queued, blocking
+	void finish();
+	bool isIdle();
+	// Bumped by every upload, e.g. to recompute what depends on the sizes of meshes
+	int getGeneration() const { return stats.uploaded; }
+	const Stats& getStats() const { return stats; }
+
+private:
+	struct Job {
+		Load load;
+		Upload upload;
+		std::vector<unsigned char> bytes;
+	};
+	struct Region {
+		void* fence; // GLsync
+		size_t begin;
+	};
+
+	static inline ResourceLoader* installed = nullptr;
+
+	std::mutex mutex;
+	std::condition_variable queued, loaded;
+	std::deque<std::unique_ptr<Job>> waiting, finished;
+	std::vector<std::thread> workers;
+	int loading = 0;
+	bool stopping = false;
+	Stats stats;
+
+	unsigned int ring = 0;
+	unsigned char* persistent = nullptr; // the whole ring, mapped for good
+	size_t head = 0;
+	std::deque<Region> inFlight;         // oldest first
+
+	void workerLoop();
+	bool upload(Job& job);               // false if the ring has no room for it now
+	size_t allocate(size_t size);        // ring offset, or ringSize if there is no room now
+	void retire(bool wait);
+};
+
+#endif // RESOURCE_LOADER_H
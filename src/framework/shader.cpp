@@ -1,4 +1,7 @@
 #include "shader.h"
+#include "renderBackend.h"
+#include "profiler.h"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
@@ -18,6 +21,56 @@ std::string readFile(const char* filePath) {
     return content;
 }
 
+std::vector<Shader*> Shader::shaders;
+GeometryVariant Shader::geometry = GeometryVariant::Euclidean;
+std::unique_ptr<FileWatcher> Shader::watcher;
+
+MaterialUniforms::MaterialUniforms(const std::string& name) {
+    kd = GPUProgram::uniformHandle(name + ".kd");
+    ks = GPUProgram::uniformHandle(name + ".ks");
+    ka = GPUProgram::uniformHandle(name + ".ka");
+    shininess = GPUProgram::uniformHandle(name + ".shininess");
+    emission = GPUProgram::uniformHandle(name + ".emission");
+}
+
+LightUniforms::LightUniforms(const std::string& name) {
+    La = GPUProgram::uniformHandle(name + ".La");
+    Le = GPUProgram::uniformHandle(name + ".Le");
+    wLightPos = GPUProgram::uniformHandle(name + ".wLightPos");
+}
+
+FrameUniforms frameUniforms(const RenderState& state) {
+    FrameUniforms frame = {};
+    frame.V = state.V;
+    frame.P = state.P;
+    frame.VP = state.VP;
+    frame.wEye = state.eye;
+    frame.nLights = std::min(state.nLights, maxLights);
+    for (int i = 0; i < frame.nLights; i++) {
+        frame.lights[i].La = state.lights[i].La;
+        frame.lights[i].Le = state.lights[i].Le;
+        frame.lights[i].wLightPos = state.lightPositions[i];
+    }
+    return frame;
+}
+
+Shader::Shader() {
+    shaders.push_back(this);
+}
+
+Shader::Shader(const Shader& shader) : GPUProgram(shader) {
+    shaders.push_back(this);
+}
+
+Shader::~Shader() {
+    shaders.erase(std::find(shaders.begin(), shaders.end(), this));
+}
+
+void Shader::selectGeometry(GeometryVariant variant) {
+    geometry = variant;
+    for (Shader* shader : shaders) shader->setVariant((int)variant);
+}
+
 void Shader::setUniformMaterial(const Material& material, const std::string& name) {
     setUniform(material.kd, name + ".kd");
     setUniform(material.ks, name + ".ks");
@@ -41,14 +94,68 @@ void Shader::setUniformMaterial(const Material* material, const std::string& nam
     setUniform(currentMaterial->emission, name + ".emission");
 }
 
+void Shader::setUniformMaterial(const Material* material, const MaterialUniforms& uniforms) {
+    static Material defaultMaterial;
+    const Material* currentMaterial = (material == NULL) ? &defaultMaterial : material;
+    setUniform(currentMaterial->kd, uniforms.kd);
+    setUniform(currentMaterial->ks, uniforms.ks);
+    setUniform(currentMaterial->ka, uniforms.ka);
+    setUniform(currentMaterial->shininess, uniforms.shininess);
+    setUniform(currentMaterial->emission, uniforms.emission);
+}
+
+void Shader::setUniformLight(const Light& light, const LightUniforms& uniforms) {
+    setUniform(light.La, uniforms.La);
+    setUniform(light.Le, uniforms.Le);
+    setUniform(light.wLightPos, uniforms.wLightPos);
+}
+
 void Shader::createShaderFromFiles(const char* vertPath, const char* fragPath) {
-    std::string vertString = readFile(vertPath);
-    std::string fragString = readFile(fragPath);
+    if (RenderBackend::get()) return; // the backend runs the shader math itself
 
-    if (vertString.empty() || fragString.empty()) {
+    vertSource = readFile(vertPath);
+    fragSource = readFile(fragPath);
+
+    if (vertSource.empty() || fragSource.empty()) {
         std::cerr << "Error: Shader file(s) not found or empty" << std::endl;
         return;
     }
+    this->vertPath = vertPath;
+    this->fragPath = fragPath;
+    if (watcher) watcher->watch({ this->vertPath, this->fragPath });
+    compileVariants(false);
+}
+
+void Shader::enableHotReload() {
+    if (watcher) return;
+    watcher.reset(new FileWatcher());
+    for (Shader* shader : shaders) {
+        if (!shader->vertPath.empty()) watcher->watch({ shader->vertPath, shader->fragPath });
+    }
+}
+
+void Shader::updateHotReload() {
+    if (!watcher) return;
+    PROFILE_ZONE("Shader::updateHotReload");
+    std::vector<std::pair<std::string, std::string>> changes = watcher->takeChanges();
+    for (Shader* shader : shaders) {
+        bool changed = false;
+        for (const auto& change : changes) {
+            if (change.first == shader->vertPath) shader->vertSource = change.second;
+            else if (change.first == shader->fragPath) shader->fragSource = change.second;
+            else continue;
+            changed = true;
+        }
+        if (changed) {
+            shader->cancelReload(); // edited again before the last edit compiled
+            shader->compileVariants(true);
+        }
+        shader->finishReload();
+    }
+}
+
+void Shader::compileVariants(bool reload) {
+    std::string vertString = vertSource, fragString = fragSource;
 
     // Replace the version for webgl
 #ifdef __EMSCRIPTEN__
@@ -57,5 +164,21 @@ void Shader::createShaderFromFiles(const char* vertPath, const char* fragPath) {
     fragString.replace(0, fragString.find('\n'), webglVersion);
 #endif
 
-    create(vertString.c_str(), fragString.c_str());
+    // the defines of the variants go right after the #version line
+    const char* const variantDefines[] = { "GEOMETRY_HYPERBOLIC", "GEOMETRY_EUCLIDEAN", "GEOMETRY_SPHERICAL" };
+    static_assert(sizeof(variantDefines) / sizeof(variantDefines[0]) == (size_t)GeometryVariant::Count, "a define per variant");
+    size_t vertInsert = vertString.find('\n') + 1, fragInsert = fragString.find('\n') + 1;
+    for (int variant = 0; variant < (int)GeometryVariant::Count; variant++) {
+        std::string define = std::string("#define ") + variantDefines[variant] + "\n";
+        std::string vert = std::string(vertString).insert(vertInsert, define);
+        std::string frag = std::string(fragString).insert(fragInsert, define);
+        if (reload) {
+            beginReload(variant, vert.c_str(), frag.c_str());
+        }
+        else {
+            setVariant(variant);
+            create(vert.c_str(), frag.c_str());
+        }
+    }
+    if (!reload) setVariant((int)geometry);
 }
@@ -1,7 +1,11 @@
 #ifndef SHADER_H
 #define SHADER_H
 #include "gpuProgram.h"
+#include "geometry.h"
 #include "texture.h"
+#include "uniformBuffer.h"
+#include "fileWatcher.h"
+#include <memory>
 
 struct Material {
 	vec3 kd, ks, ka;
@@ -15,21 +19,95 @@ struct Light {
 	vec4 wLightPos; // homogeneous coordinates, can be at ideal point
 };
 
+const int maxLights = 8;                   // Light[8] lights in geom.vert and geom.frag
+const unsigned int frameUniformsBinding = 0;
+
+// Variants of the shaders, one per geometry. createShaderFromFiles compiles the sources
+// once with each of GEOMETRY_HYPERBOLIC, GEOMETRY_EUCLIDEAN and GEOMETRY_SPHERICAL defined.
+enum class GeometryVariant { Hyperbolic, Euclidean, Spherical, Count };
+
+// std140 mirror of the FrameUniforms block of the shaders, uploaded once per frame.
+// Matrices are declared row_major in the block, so mat4 is copied as is. The eye and
+// the light positions are in the current space, the curvature is compiled into the
+// shader variants.
+struct FrameUniforms {
+	struct LightBlock {
+		vec3 La;        float pad0;
+		vec3 Le;        float pad1;
+		vec4 wLightPos;
+	};
+
+	mat4 V, P, VP;
+	vec4 wEye;
+	int nLights;
+	float pad[3];
+	LightBlock lights[maxLights];
+};
+static_assert(sizeof(FrameUniforms::LightBlock) == 48, "std140 Light is 48 bytes");
+static_assert(sizeof(FrameUniforms) == 3 * 64 + 16 + 16 + maxLights * 48, "FrameUniforms does not match std140");
+
+struct MaterialUniforms {
+	UniformHandle kd, ks, ka, shininess, emission;
+
+	MaterialUniforms() {}
+	MaterialUniforms(const std::string& name);
+};
+
+struct LightUniforms {
+	UniformHandle La, Le, wLightPos;
+
+	LightUniforms() {}
+	LightUniforms(const std::string& name);
+};
+
 struct RenderState {
-	mat4	           VP, Scale, Rotate, Translate, Minv, V, P;
+	mat4	           VP, ScaleRotate, Translate, Minv, V, P;
+	mat4               Normal;            // transpose(inverse(ScaleRotate))
 	Material *         material;
-	std::vector<Light> lights;
+	const Light *      lights = nullptr;  // the scene's, not copied every frame
+	int                nLights = 0;
 	Texture *          texture;
 	vec4	           wEye;
+	vec4               eye;                      // wEye in the current space
+	vec4               lightPositions[maxLights]; // wLightPos of the lights in the current space
+	bool               instanced = false; // modeling transforms come from the instance attributes
+	VertexFormat       vertexFormat = VertexFormat::Float; // of the mesh drawn next
 };
 
+FrameUniforms frameUniforms(const RenderState& state);
+
 class Shader : public GPUProgram {
+    static std::vector<Shader*> shaders; // alive, switched together by selectGeometry
+    static GeometryVariant geometry;
+    static std::unique_ptr<FileWatcher> watcher;
+
+    std::string vertPath, fragPath;      // of createShaderFromFiles, watched for hot reload
+    std::string vertSource, fragSource;  // as read, without the variant defines
+
+    void compileVariants(bool reload);
+
 public:
-	virtual void Bind(RenderState state) = 0;
+    Shader();
+    Shader(const Shader& shader);
+    virtual ~Shader();
+
+	virtual void Bind(const RenderState& state) = 0;
+
+    // Makes every shader use its variant compiled for the geometry
+    static void selectGeometry(GeometryVariant variant);
+
+    // Hot reload: the files of the shaders created from files are watched from now on
+    static void enableHotReload();
+    // Once per frame: starts compiling the shaders whose files were edited and swaps in
+    // the ones that finished linking, see GPUProgram::beginReload. Never waits for the
+    // compiler or the files.
+    static void updateHotReload();
 
     void setUniformMaterial(const Material &material, const std::string &name);
     void setUniformLight(const Light &light, const std::string &name);
     void setUniformMaterial(const Material *material, const std::string &name);
+    void setUniformMaterial(const Material *material, const MaterialUniforms &uniforms);
+    void setUniformLight(const Light &light, const LightUniforms &uniforms);
     void createShaderFromFiles(const char* vertPath, const char* fragPath);
 };
 
@@ -1,5 +1,13 @@
 #include "texture.h"
+#include "renderBackend.h"
+#include "profiler.h"
+#include "mappedFile.h"
+#include "resourceLoader.h"
+#include "glStateCache.h"
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
 
 Texture::Texture() { 
     textureId = 0; 
@@ -23,53 +31,251 @@ void Texture::operator=(const Texture& texture) {
     printf("\nError: Texture resource is not copied on GPU!!!\n");
 }
 
-std::vector<vec4> Texture::load(std::string pathname, bool transparent, int& width, int& height) {
-    FILE* file = fopen(pathname.c_str(), "r");
-    if (!file) {
-        printf("%s does not exist\n", pathname.c_str());
-        width = height = 0;
-        return std::vector<vec4>();
+namespace {
+
+// GL_EXT_texture_filter_anisotropic, core since GL 4.6
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
+const float anisotropy = 16.0f; // at most, where supported
+const size_t bandBytes = 1 << 20; // BMP rows uploaded at once
+
+bool hasExtension(const char* name) {
+    int nExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+    for (int i = 0; i < nExtensions; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0) return true;
+    }
+    return false;
+}
+
+float maxAnisotropy() {
+    static float max = -1.0f;
+    if (max < 0.0f) {
+        max = 0.0f;
+        if (hasExtension("GL_EXT_texture_filter_anisotropic") || hasExtension("GL_ARB_texture_filter_anisotropic")) {
+            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max);
+        }
+    }
+    return max;
+}
+
+// BC1 is S3TC, WebGL names the extension differently
+bool hasBC1() {
+    static int supported = -1;
+    if (supported < 0) {
+        supported = hasExtension("GL_EXT_texture_compression_s3tc") || hasExtension("GL_WEBGL_compressed_texture_s3tc") ||
+                    hasExtension("GL_EXT_texture_compression_dxt1");
     }
-    unsigned short bitmapFileHeader[27];                    // bitmap header
-    fread(&bitmapFileHeader, 27, 2, file);
-    if (bitmapFileHeader[0] != 0x4D42) printf("Not bmp file\n");
-    if (bitmapFileHeader[14] != 24) printf("Only true color bmp files are supported\n");
-    width = bitmapFileHeader[9];
-    height = bitmapFileHeader[11];
-    unsigned int size = (unsigned long)bitmapFileHeader[17] + (unsigned long)bitmapFileHeader[18] * 65536;
-    fseek(file, 54, SEEK_SET);
-    std::vector<unsigned char> bImage(size);
-    fread(&bImage[0], 1, size, file);     // read the pixels
-    fclose(file);
-    std::vector<vec4> image(width * height);
-    int i = 0;
-    for (unsigned int idx = 0; idx < size; idx += 3) { // Swap R and B since in BMP, the order is BGR
-        float alpha = (transparent) ? (bImage[idx] + bImage[idx + 1] + bImage[idx + 2]) / 3.0f / 256.0f : 1.0f;
-        image[i++] = vec4(bImage[idx + 2] / 256.0f, bImage[idx + 1] / 256.0f, bImage[idx] / 256.0f, alpha);
+    return supported == 1;
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Magenta and black checkers, so that a texture that failed to load stands out
+TextureImage placeholderImage() {
+    const int size = 8;
+    TextureImage image;
+    image.width = image.height = size;
+    image.texels.resize(size * size * 4);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            unsigned char* texel = &image.texels[(y * size + x) * 4];
+            unsigned char on = (x ^ y) & 1 ? 255 : 0;
+            texel[0] = on; texel[1] = 0; texel[2] = on; texel[3] = 255;
+        }
     }
     return image;
 }
 
+} // namespace
+
 void Texture::create(std::string pathname, bool transparent) {
-    int width, height;
-    std::vector<vec4> image = load(pathname, transparent, width, height);
-    if (image.size() > 0) create(width, height, image);
+    PROFILE_ZONE("Texture::load");
+    if (endsWith(pathname, ".ctex")) {
+        CompressedTexture texture;
+        if (!readCompressedTexture(pathname, texture)) {
+            createPlaceholder(pathname);
+            return;
+        }
+        width = texture.width;
+        height = texture.height;
+        if (RenderBackend::get() || !hasBC1()) {
+            // decoded to RGBA8, the mip levels are generated again
+            create(decompressBC1(texture.data.data(), texture.width, texture.height), sampling);
+        }
+        else {
+            uploadCompressed(texture);
+        }
+        return;
+    }
+
+    if (RenderBackend::get() || ResourceLoader::get()) {
+        stream([pathname, transparent](TextureImage& image) { return loadBMP(pathname, transparent, image); }, GL_LINEAR, false, pathname);
+        return;
+    }
+    MappedFile file;
+    if (!file.open(pathname)) {
+        printf("%s does not exist\n", pathname.c_str());
+        createPlaceholder(pathname);
+        return;
+    }
+    BMPImage bmp;
+    if (!parseBMP(file.data(), file.size(), pathname, bmp)) {
+        createPlaceholder(pathname);
+        return;
+    }
+    width = bmp.width;
+    height = bmp.height;
+    srgb = false;
+    uploadBMP(bmp, transparent);
 }
 
 void Texture::create(int width, int height, const std::vector<vec4>& image, int sampling) {
+    if (RenderBackend* backend = RenderBackend::get()) {
+        PROFILE_ZONE("Texture::create");
+        this->width = width;
+        this->height = height;
+        this->sampling = sampling;
+        if (textureId > 0) backend->deleteTexture(textureId);
+        textureId = backend->createTexture(width, height, image, sampling);
+        return;
+    }
+    create(toTextureImage(width, height, image), sampling);
+}
+
+void Texture::create(const TextureImage& image, int sampling, bool srgb) {
+    PROFILE_ZONE("Texture::create");
+    this->width = image.width;
+    this->height = image.height;
+    this->sampling = sampling;
+    this->srgb = srgb;
+    if (RenderBackend* backend = RenderBackend::get()) {
+        if (textureId > 0) backend->deleteTexture(textureId);
+        textureId = backend->createTexture(image.width, image.height, toVec4Image(image), sampling);
+        return;
+    }
+    upload(image.texels.data());
+}
+
+void Texture::createPlaceholder(const std::string& name) {
+    printf("%s could not be loaded, drawn with a placeholder\n", name.c_str());
+    create(placeholderImage(), GL_NEAREST);
+}
+
+void Texture::stream(std::function<bool(TextureImage& image)> decode, int sampling, bool srgb, const std::string& name) {
+    ResourceLoader* loader = ResourceLoader::get();
+    if (!loader || RenderBackend::get()) {
+        TextureImage image;
+        if (decode(image) && image.texels.size() > 0) create(image, sampling, srgb);
+        else createPlaceholder(name);
+        return;
+    }
+    // the texels go on in the loader's bytes, the size stays here
+    std::shared_ptr<TextureImage> image = std::make_shared<TextureImage>();
+    streaming = true;
+    loader->add([decode, image](std::vector<unsigned char>& bytes) {
+        if (decode(*image)) bytes.swap(image->texels);
+    }, [this, image, sampling, srgb, name](const ResourceLoader::Staged& staged) {
+        PROFILE_ZONE("Texture::create");
+        streaming = false;
+        if (staged.size == 0) {
+            createPlaceholder(name);
+            return;
+        }
+        width = image->width;
+        height = image->height;
+        this->sampling = sampling;
+        this->srgb = srgb;
+        upload(staged.pixels(0));
+    });
+}
+
+void Texture::upload(const void* texels) {
     if (textureId == 0) glGenTextures(1, &textureId);      // id generation
-    glBindTexture(GL_TEXTURE_2D, textureId);    // binding
+    GLStateCache::bindTexture(textureId);       // binding
+
+    // 4 bytes per texel instead of the 16 of GL_RGBA32F, every row is 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, texels); // To GPU
+    generateMipmaps();
+}
+
+void Texture::uploadBMP(const BMPImage& bmp, bool transparent) {
+    if (textureId == 0) glGenTextures(1, &textureId);
+    GLStateCache::bindTexture(textureId);
 
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 #ifdef __EMSCRIPTEN__
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, &image[0]); // To GPU
+    bool direct = false; // WebGL takes no BGR
 #else
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_FLOAT, &image[0]); // To GPU
+    // GL reads BGR(A) and the rows padded to 4 bytes as they are in the file
+    bool direct = !transparent && !bmp.topDown && (bmp.bytesPerTexel == 3 || bmp.alpha);
 #endif
+    int bandRows = std::max(1, (int)(bandBytes / ((size_t)width * 4)));
+    std::vector<unsigned char> band;
+    for (int y = 0; y < height; y += bandRows) {
+        int rows = std::min(bandRows, height - y);
+#ifndef __EMSCRIPTEN__
+        if (direct) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, rows, bmp.bytesPerTexel == 3 ? GL_BGR : GL_BGRA, GL_UNSIGNED_BYTE, bmp.row(y));
+            continue;
+        }
+#endif
+        band.resize((size_t)width * rows * 4);
+        convertBMPRows(bmp, transparent, y, rows, band.data());
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, band.data());
+    }
+    generateMipmaps();
+}
+
+void Texture::generateMipmaps() {
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    int levels = mipLevels(width, height);
+    bytes = 0;
+    for (int level = 0, w = width, h = height; level < levels; level++, w = std::max(w / 2, 1), h = std::max(h / 2, 1)) {
+        bytes += (size_t)w * h * 4;
+    }
+    setFilters(levels);
+}
+
+void Texture::uploadCompressed(const CompressedTexture& texture) {
+    if (textureId == 0) glGenTextures(1, &textureId);
+    GLStateCache::bindTexture(textureId);
+
+    // from the buffer the file was read into
+    int levels = (int)texture.levelSizes.size();
+    bytes = texture.data.size();
+    for (int level = 0, w = width, h = height; level < levels; level++, w = std::max(w / 2, 1), h = std::max(h / 2, 1)) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.format, w, h, 0, (GLsizei)texture.levelSizes[level],
+                               &texture.data[texture.levelOffsets[level]]);
+    }
+    setFilters(levels);
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampling); // sampling
+// Trilinear when minified, so distant texels are averaged instead of aliasing; sampling
+// only decides magnification, GL_NEAREST keeps the checkerboards sharp up close.
+void Texture::setFilters(int levels) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : sampling);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampling);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    // only smooth textures, it blurs the edges that nearest sampling keeps sharp
+    if (sampling == GL_LINEAR && maxAnisotropy() > 1.0f) glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(anisotropy, maxAnisotropy()));
 }
 
 Texture::~Texture() {
-    if (textureId > 0) glDeleteTextures(1, &textureId);
+    if (textureId == 0) return;
+    if (RenderBackend* backend = RenderBackend::get()) backend->deleteTexture(textureId);
+    else {
+        GLStateCache::forgetTexture(textureId);
+        glDeleteTextures(1, &textureId);
+    }
 } 
\ No newline at end of file
@@ -7,23 +7,47 @@
 #include <glad/glad.h>
 #endif
 
+#include <functional>
 #include <string>
 #include <vector>
 #include "frameworkMath.h"
+#include "textureData.h"
 
+// Stored with 8 bits per channel and a full mip chain, sampled trilinearly when minified
+// and anisotropically where the driver can. Precompressed .ctex files, see textureData.h,
+// are uploaded as they are read. BMP files are uploaded from where they are mapped, in
+// bands of rows, so a large texture never needs a second copy of itself in memory.
+// With a ResourceLoader installed, textures are decoded on its threads and uploaded later.
 class Texture {
-    std::vector<vec4> load(std::string pathname, bool transparent, int& width, int& height);
+    bool streaming = false; // queued in the ResourceLoader, not uploaded yet
+
+    void upload(const void* texels);
+    void uploadBMP(const BMPImage& bmp, bool transparent);
+    void generateMipmaps();
+    void uploadCompressed(const CompressedTexture& texture);
+    void setFilters(int levels);
+    void createPlaceholder(const std::string& name); // for a texture that failed to load
 
 public:
-    unsigned int textureId;
+    unsigned int textureId; // GL name, or handle in the RenderBackend
+    int width = 0, height = 0, sampling = GL_LINEAR; // sampling: magnification filter
+    bool srgb = false;      // texels are sRGB encoded, decoded to linear when sampled
+    size_t bytes = 0;       // on the GPU, with the mip levels
 
     Texture();
     Texture(std::string pathname, bool transparent = false);
     Texture(int width, int height, const std::vector<vec4>& image, int sampling = GL_LINEAR);
     Texture(const Texture& texture);
     void operator=(const Texture& texture);
+    // BMP, or .ctex made by texture_converter
     void create(std::string pathname, bool transparent = false);
     void create(int width, int height, const std::vector<vec4>& image, int sampling = GL_LINEAR);
+    void create(const TextureImage& image, int sampling = GL_LINEAR, bool srgb = false);
+    // decode makes the image, on a loader thread if a ResourceLoader is installed. If it fails,
+    // name is printed and a placeholder is drawn instead.
+    void stream(std::function<bool(TextureImage& image)> decode, int sampling = GL_LINEAR, bool srgb = false,
+                const std::string& name = "streamed texture");
+    bool isReady() const { return !streaming; }
     ~Texture();
 }; 
 
@@ -0,0 +1,320 @@
+#include "textureData.h"
+#include "mappedFile.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+inline unsigned char toByte(float c) {
+    if (!(c > 0.0f)) return 0;
+    if (c >= 1.0f) return 255;
+    return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+// RGB565 of a BC1 endpoint
+inline uint16_t pack565(const unsigned char* rgb) {
+    return (uint16_t)(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+}
+
+inline void unpack565(uint16_t c, unsigned char* rgb) {
+    int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+    rgb[0] = (unsigned char)(r << 3 | r >> 2);
+    rgb[1] = (unsigned char)(g << 2 | g >> 4);
+    rgb[2] = (unsigned char)(b << 3 | b >> 2);
+}
+
+// The 4 colors of a block in 4 color mode, color0 > color1
+void palette(uint16_t color0, uint16_t color1, unsigned char colors[4][3]) {
+    unpack565(color0, colors[0]);
+    unpack565(color1, colors[1]);
+    for (int c = 0; c < 3; c++) {
+        colors[2][c] = (unsigned char)((2 * colors[0][c] + colors[1][c] + 1) / 3);
+        colors[3][c] = (unsigned char)((colors[0][c] + 2 * colors[1][c] + 1) / 3);
+    }
+}
+
+inline int distance2(const unsigned char* a, const unsigned char* b) {
+    int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+    return dr * dr + dg * dg + db * db;
+}
+
+// Endpoints are the two texels farthest apart, exact for blocks of two colors like the
+// checkerboards; the texels take the nearest of the 4 colors between them.
+void compressBlock(const unsigned char block[16][3], unsigned char* out) {
+    int first = 0, second = 0, farthest = -1;
+    for (int i = 0; i < 16; i++) {
+        for (int j = i + 1; j < 16; j++) {
+            int d = distance2(block[i], block[j]);
+            if (d > farthest) farthest = d, first = i, second = j;
+        }
+    }
+    uint16_t color0 = pack565(block[first]), color1 = pack565(block[second]);
+    if (color0 < color1) std::swap(color0, color1);
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        unsigned char colors[4][3];
+        palette(color0, color1, colors);
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            for (int k = 1; k < 4; k++) {
+                if (distance2(block[i], colors[k]) < distance2(block[i], colors[best])) best = k;
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+    for (int i = 0; i < 4; i++) out[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// BMP headers are little endian and not aligned
+inline uint16_t read16(const unsigned char* p) { return (uint16_t)(p[0] | p[1] << 8); }
+inline uint32_t read32(const unsigned char* p) { return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; }
+
+struct CompressedTextureHeader {
+    char     magic[4];
+    uint32_t version, format, width, height, levels;
+};
+const char ctexMagic[4] = { 'C', 'T', 'E', 'X' };
+const uint32_t ctexVersion = 1;
+
+} // namespace
+
+TextureImage toTextureImage(int width, int height, const std::vector<vec4>& image) {
+    TextureImage result;
+    result.width = width;
+    result.height = height;
+    result.texels.resize((size_t)width * height * 4);
+    for (size_t i = 0; i < image.size() && i < (size_t)width * height; i++) {
+        result.texels[4 * i + 0] = toByte(image[i].x);
+        result.texels[4 * i + 1] = toByte(image[i].y);
+        result.texels[4 * i + 2] = toByte(image[i].z);
+        result.texels[4 * i + 3] = toByte(image[i].w);
+    }
+    return result;
+}
+
+std::vector<vec4> toVec4Image(const TextureImage& image) {
+    std::vector<vec4> result((size_t)image.width * image.height);
+    const unsigned char* t = image.texels.data();
+    for (size_t i = 0; i < result.size(); i++, t += 4) {
+        result[i] = vec4(t[0] / 255.0f, t[1] / 255.0f, t[2] / 255.0f, t[3] / 255.0f);
+    }
+    return result;
+}
+
+bool parseBMP(const unsigned char* file, size_t size, const std::string& pathname, BMPImage& bmp) {
+    bmp = BMPImage();
+    const size_t fileHeaderSize = 14;
+    uint32_t infoSize = size >= fileHeaderSize + 40 ? read32(file + 14) : 0;
+    if (infoSize < 40 || file[0] != 'B' || file[1] != 'M' || fileHeaderSize + infoSize > size) {
+        printf("%s is not a BMP file\n", pathname.c_str());
+        return false;
+    }
+    uint32_t pixelOffset = read32(file + 10);
+    int32_t width = (int32_t)read32(file + 18), height = (int32_t)read32(file + 22);
+    uint16_t planes = read16(file + 26), bitsPerTexel = read16(file + 28);
+    uint32_t compression = read32(file + 30);
+    // the channel masks follow the 40 byte header, or are its last fields in the later versions
+    bool hasAlphaMask = compression == 6 || infoSize >= 56;
+    bool masks = (compression == 3 || compression == 6) && // BI_BITFIELDS, BI_ALPHABITFIELDS
+                 fileHeaderSize + 40 + (hasAlphaMask ? 16 : 12) <= size;
+    bool bgra = masks && read32(file + 54) == 0x00FF0000 && read32(file + 58) == 0x0000FF00 && read32(file + 62) == 0x000000FF;
+    bool supported = planes == 1 &&
+                     ((bitsPerTexel == 24 && compression == 0) || (bitsPerTexel == 32 && (compression == 0 || bgra)));
+    if (!supported) {
+        printf("%s: only uncompressed 24 and 32 bit BMP files are supported\n", pathname.c_str());
+        return false;
+    }
+
+    int64_t rows = height < 0 ? -(int64_t)height : height;
+    if (width <= 0 || rows == 0 || width > 16384 || rows > 16384) {
+        printf("%s: invalid size %d x %d\n", pathname.c_str(), width, height);
+        return false;
+    }
+
+    bmp.width = width;
+    bmp.height = (int)rows;
+    bmp.topDown = height < 0;
+    bmp.bytesPerTexel = bitsPerTexel / 8;
+    // BI_RGB leaves the 4th byte unused, often 0, only a mask makes it alpha
+    bmp.alpha = bgra && hasAlphaMask && read32(file + 66) == 0xFF000000;
+    bmp.rowStride = ((size_t)bmp.width * bmp.bytesPerTexel + 3) & ~(size_t)3;
+    if (pixelOffset < fileHeaderSize + infoSize || pixelOffset > size || bmp.rowStride * bmp.height > size - pixelOffset) {
+        printf("%s is truncated or corrupt\n", pathname.c_str());
+        bmp = BMPImage();
+        return false;
+    }
+    bmp.pixels = file + pixelOffset;
+    return true;
+}
+
+void convertBMPRows(const BMPImage& bmp, bool transparent, int firstRow, int rows, unsigned char* texels) {
+    for (int y = firstRow; y < firstRow + rows; y++) {
+        const unsigned char* p = bmp.row(y);
+        for (int x = 0; x < bmp.width; x++, p += bmp.bytesPerTexel, texels += 4) {
+            // Swap R and B since in BMP, the order is BGR
+            texels[0] = p[2];
+            texels[1] = p[1];
+            texels[2] = p[0];
+            if (transparent) texels[3] = (unsigned char)((p[0] + p[1] + p[2]) / 3);
+            else texels[3] = bmp.alpha ? p[3] : 255;
+        }
+    }
+}
+
+bool loadBMP(const std::string& pathname, bool transparent, TextureImage& image) {
+    image = TextureImage();
+    MappedFile file;
+    if (!file.open(pathname)) {
+        printf("%s does not exist\n", pathname.c_str());
+        return false;
+    }
+    BMPImage bmp;
+    if (!parseBMP(file.data(), file.size(), pathname, bmp)) return false;
+    image.width = bmp.width;
+    image.height = bmp.height;
+    image.texels.resize((size_t)bmp.width * bmp.height * 4);
+    convertBMPRows(bmp, transparent, 0, bmp.height, image.texels.data());
+    return true;
+}
+
+TextureImage downsample(const TextureImage& image) {
+    TextureImage result;
+    result.width = std::max(image.width / 2, 1);
+    result.height = std::max(image.height / 2, 1);
+    result.texels.resize((size_t)result.width * result.height * 4);
+    for (int y = 0; y < result.height; y++) {
+        int y0 = std::min(2 * y, image.height - 1), y1 = std::min(2 * y + 1, image.height - 1);
+        for (int x = 0; x < result.width; x++) {
+            int x0 = std::min(2 * x, image.width - 1), x1 = std::min(2 * x + 1, image.width - 1);
+            const unsigned char* t00 = &image.texels[((size_t)y0 * image.width + x0) * 4];
+            const unsigned char* t01 = &image.texels[((size_t)y0 * image.width + x1) * 4];
+            const unsigned char* t10 = &image.texels[((size_t)y1 * image.width + x0) * 4];
+            const unsigned char* t11 = &image.texels[((size_t)y1 * image.width + x1) * 4];
+            unsigned char* out = &result.texels[((size_t)y * result.width + x) * 4];
+            for (int c = 0; c < 4; c++) out[c] = (unsigned char)((t00[c] + t01[c] + t10[c] + t11[c] + 2) / 4);
+        }
+    }
+    return result;
+}
+
+void compressBC1(const TextureImage& image, unsigned char* blocks) {
+    for (int by = 0; by < image.height; by += 4) {
+        for (int bx = 0; bx < image.width; bx += 4) {
+            unsigned char block[16][3];
+            for (int i = 0; i < 16; i++) {
+                // texels past the edge repeat the last row and column
+                int x = std::min(bx + i % 4, image.width - 1), y = std::min(by + i / 4, image.height - 1);
+                memcpy(block[i], &image.texels[((size_t)y * image.width + x) * 4], 3);
+            }
+            compressBlock(block, blocks);
+            blocks += 8;
+        }
+    }
+}
+
+TextureImage decompressBC1(const unsigned char* blocks, int width, int height) {
+    TextureImage image;
+    image.width = width;
+    image.height = height;
+    image.texels.resize((size_t)width * height * 4);
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            uint16_t color0 = (uint16_t)(blocks[0] | blocks[1] << 8), color1 = (uint16_t)(blocks[2] | blocks[3] << 8);
+            uint32_t indices = (uint32_t)blocks[4] | (uint32_t)blocks[5] << 8 | (uint32_t)blocks[6] << 16 | (uint32_t)blocks[7] << 24;
+            unsigned char colors[4][3];
+            palette(color0, color1, colors);
+            if (color0 <= color1) { // 3 color mode, index 3 is black
+                for (int c = 0; c < 3; c++) {
+                    colors[2][c] = (unsigned char)((colors[0][c] + colors[1][c]) / 2);
+                    colors[3][c] = 0;
+                }
+            }
+            for (int i = 0; i < 16; i++) {
+                int x = bx + i % 4, y = by + i / 4;
+                if (x >= width || y >= height) continue;
+                unsigned char* out = &image.texels[((size_t)y * width + x) * 4];
+                memcpy(out, colors[indices >> (2 * i) & 3], 3);
+                out[3] = 255;
+            }
+            blocks += 8;
+        }
+    }
+    return image;
+}
+
+CompressedTexture compressTexture(const TextureImage& image) {
+    CompressedTexture texture;
+    texture.format = bc1Format;
+    texture.width = image.width;
+    texture.height = image.height;
+    int levels = mipLevels(image.width, image.height);
+    size_t total = 0;
+    for (int level = 0, w = image.width, h = image.height; level < levels; level++, w = std::max(w / 2, 1), h = std::max(h / 2, 1)) {
+        texture.levelOffsets.push_back(total);
+        texture.levelSizes.push_back(bc1Size(w, h));
+        total += bc1Size(w, h);
+    }
+    texture.data.resize(total);
+    TextureImage level = image;
+    for (int i = 0; i < levels; i++) {
+        if (i > 0) level = downsample(level);
+        compressBC1(level, &texture.data[texture.levelOffsets[i]]);
+    }
+    return texture;
+}
+
+bool writeCompressedTexture(const std::string& pathname, const CompressedTexture& texture) {
+    FILE* file = fopen(pathname.c_str(), "wb");
+    if (!file) {
+        printf("Cannot write %s\n", pathname.c_str());
+        return false;
+    }
+    CompressedTextureHeader header;
+    memcpy(header.magic, ctexMagic, sizeof(ctexMagic));
+    header.version = ctexVersion;
+    header.format = texture.format;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.levels = (uint32_t)texture.levelSizes.size();
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(texture.data.data(), 1, texture.data.size(), file) == texture.data.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) printf("Cannot write %s\n", pathname.c_str());
+    return ok;
+}
+
+bool readCompressedTexture(const std::string& pathname, CompressedTexture& texture) {
+    texture = CompressedTexture();
+    FILE* file = fopen(pathname.c_str(), "rb");
+    if (!file) {
+        printf("%s does not exist\n", pathname.c_str());
+        return false;
+    }
+    CompressedTextureHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, ctexMagic, sizeof(ctexMagic)) == 0 &&
+              header.version == ctexVersion && header.format == bc1Format &&
+              header.width > 0 && header.height > 0 && header.width <= 16384 && header.height <= 16384 &&
+              header.levels == (uint32_t)mipLevels(header.width, header.height);
+    if (ok) {
+        texture.format = header.format;
+        texture.width = header.width;
+        texture.height = header.height;
+        size_t total = 0;
+        for (int level = 0, w = texture.width, h = texture.height; level < (int)header.levels; level++, w = std::max(w / 2, 1), h = std::max(h / 2, 1)) {
+            texture.levelOffsets.push_back(total);
+            texture.levelSizes.push_back(bc1Size(w, h));
+            total += bc1Size(w, h);
+        }
+        // the levels straight into the upload buffer, the only copy of the data
+        texture.data.resize(total);
+        ok = fread(texture.data.data(), 1, total, file) == total;
+    }
+    fclose(file);
+    if (!ok) {
+        printf("%s is not a valid compressed texture\n", pathname.c_str());
+        texture = CompressedTexture();
+    }
+    return ok;
+}
@@ -0,0 +1,77 @@
+#ifndef TEXTURE_DATA_H
+#define TEXTURE_DATA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "frameworkMath.h"
+
+// The CPU side of textures, without GL: 8 bit RGBA images, their mip chains, the BC1
+// codec and the .ctex files of precompressed textures. Images are stored row by row
+// from the bottom, as glTexImage2D takes them.
+
+// 8 bit RGBA, 4 bytes per texel
+struct TextureImage {
+    int width = 0, height = 0;
+    std::vector<unsigned char> texels;
+};
+
+// Rounds and clamps the channels to 8 bits
+TextureImage toTextureImage(int width, int height, const std::vector<vec4>& image);
+std::vector<vec4> toVec4Image(const TextureImage& image);
+
+// The texels of a BMP file where they are in memory, e.g. in a MappedFile. Uncompressed
+// 24 bit BGR and 32 bit BGRA files are supported, rows are padded to 4 bytes.
+struct BMPImage {
+    int width = 0, height = 0;
+    int bytesPerTexel = 0;     // 3 or 4
+    bool alpha = false;        // the 4th byte is alpha, not unused
+    bool topDown = false;      // rows are stored from the top, a negative height in the file
+    size_t rowStride = 0;
+    const unsigned char* pixels = nullptr; // the first row in the file
+
+    // row y from the bottom, as GL counts them
+    const unsigned char* row(int y) const { return pixels + (size_t)(topDown ? height - 1 - y : y) * rowStride; }
+};
+
+// Checks the headers and that the rows are inside the size bytes of the file
+bool parseBMP(const unsigned char* file, size_t size, const std::string& pathname, BMPImage& bmp);
+// Rows firstRow... from the bottom to RGBA8, tightly packed
+void convertBMPRows(const BMPImage& bmp, bool transparent, int firstRow, int rows, unsigned char* texels);
+
+// BMP files, mapped and converted in one pass. With transparent, alpha is the brightness
+// of the texel.
+bool loadBMP(const std::string& pathname, bool transparent, TextureImage& image);
+
+// The next smaller level of the mip chain, a 2x2 box filter
+TextureImage downsample(const TextureImage& image);
+inline int mipLevels(int width, int height) {
+    int levels = 1;
+    while (width > 1 || height > 1) width = std::max(width / 2, 1), height = std::max(height / 2, 1), levels++;
+    return levels;
+}
+
+// BC1 (DXT1, GL_COMPRESSED_RGB_S3TC_DXT1_EXT): 4x4 texel blocks of 8 bytes, two RGB565
+// endpoints and a 2 bit index per texel, 8x smaller than RGBA8. Alpha is not kept.
+const unsigned int bc1Format = 0x83F0;
+inline size_t bc1Size(int width, int height) { return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8; }
+void compressBC1(const TextureImage& image, unsigned char* blocks);
+TextureImage decompressBC1(const unsigned char* blocks, int width, int height);
+
+// A precompressed texture with all its mip levels, made offline by texture_converter.
+// The .ctex file is a header followed by the levels, from the largest, so it is read
+// into data in one go and the levels are uploaded from there.
+struct CompressedTexture {
+    unsigned int format = 0; // GL internal format
+    int width = 0, height = 0;
+    std::vector<size_t> levelOffsets, levelSizes;
+    std::vector<unsigned char> data;
+};
+
+CompressedTexture compressTexture(const TextureImage& image);
+bool writeCompressedTexture(const std::string& pathname, const CompressedTexture& texture);
+bool readCompressedTexture(const std::string& pathname, CompressedTexture& texture);
+
+#endif // TEXTURE_DATA_H
@@ -0,0 +1,30 @@
+#include "uniformBuffer.h"
+#include "renderBackend.h"
+#include <stdio.h>
+
+void UniformBuffer::create(size_t _size, unsigned int _binding) {
+	size = _size;
+	binding = _binding;
+	if (RenderBackend::get()) return; // the backend gets the uniforms with bind()
+
+	if (ubo == 0) glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+}
+
+void UniformBuffer::update(const void* data, size_t dataSize) {
+	if (ubo == 0) return;
+	if (dataSize != size) {
+		printf("Uniform buffer update of %zu bytes, buffer has %zu\n", dataSize, size);
+		return;
+	}
+	// respecifying the store lets the driver hand out fresh memory instead of
+	// waiting for draws of the previous frame that still read the old content
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+}
+
+UniformBuffer::~UniformBuffer() {
+	if (ubo > 0) glDeleteBuffers(1, &ubo);
+}
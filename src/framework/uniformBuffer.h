@@ -0,0 +1,30 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#ifdef __EMSCRIPTEN__
+#include <GLES3/gl3.h>
+#else
+#include <glad/glad.h>
+#endif
+
+#include <cstddef>
+
+// Uniform buffer object attached to a fixed binding point. Programs connect
+// their uniform blocks to the same point with GPUProgram::bindUniformBlock.
+class UniformBuffer {
+	unsigned int ubo = 0;
+	unsigned int binding = 0;
+	size_t size = 0;
+
+public:
+	UniformBuffer() {}
+	UniformBuffer(const UniformBuffer&) = delete;
+	void operator=(const UniformBuffer&) = delete;
+
+	void create(size_t size, unsigned int binding);
+	void update(const void* data, size_t size); // replaces the whole content
+	unsigned int getBinding() const { return binding; }
+	~UniformBuffer();
+};
+
+#endif // UNIFORM_BUFFER_H
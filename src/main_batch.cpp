@@ -0,0 +1,162 @@
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include "softwareRasterizer.h"
+#include "scene.cpp"
+
+// Offscreen batch renderer: renders the scene along a camera path with the
+// software rasterizer and writes every frame to disk. Scene update and vertex
+// processing of frame i+1 run while frame i is rasterized and written.
+//
+// Camera path file, one frame per line ('#' starts a comment):
+//     px py pz   lx ly lz   curvature
+// position and look-at direction in euclidean coordinates, curvature is -1, 0 or 1.
+
+struct CameraKey {
+    vec4 position, lookAt;
+    float curvature;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool readCameraPath(const char* path, std::vector<CameraKey>& keys) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Could not read camera path " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        std::istringstream fields(line);
+        CameraKey key;
+        if (!(fields >> key.position.x >> key.position.y >> key.position.z
+                     >> key.lookAt.x >> key.lookAt.y >> key.lookAt.z >> key.curvature)) {
+            std::cerr << path << ":" << lineNumber << ": expected 'px py pz lx ly lz curvature'" << std::endl;
+            return false;
+        }
+        key.position.w = 1.0f;
+        keys.push_back(key);
+    }
+    return true;
+}
+
+void setCurvature(float curvature) {
+    if (curvature < 0.0f) Curvature::setHyperbolic();
+    else if (curvature > 0.0f) Curvature::setSpherical();
+    else Curvature::setEuclidean();
+}
+
+void printUsage() {
+    printf("usage: render_batch <camera path> [-o output directory] [-w width] [-h height]\n");
+    printf("                    [-f ppm|png] [-t threads] [--fps animation fps] [--trace trace.json]\n");
+    printf("                    [--honeycomb] [--lod max error in pixels]\n");
+}
+
+int main(int argc, char** argv) {
+    const char* cameraPath = nullptr;
+    std::string outputDir = ".";
+    std::string format = "ppm";
+    std::string tracePath;
+    int width = 1200, height = 800;
+    unsigned int nThreads = 0;
+    float fps = 30.0f;
+    float lodError = 0.0f;
+    bool honeycomb = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-o" && hasValue) outputDir = argv[++i];
+        else if (arg == "-w" && hasValue) width = atoi(argv[++i]);
+        else if (arg == "-h" && hasValue) height = atoi(argv[++i]);
+        else if (arg == "-f" && hasValue) format = argv[++i];
+        else if (arg == "-t" && hasValue) nThreads = atoi(argv[++i]);
+        else if (arg == "--fps" && hasValue) fps = (float)atof(argv[++i]);
+        else if (arg == "--trace" && hasValue) tracePath = argv[++i];
+        else if (arg == "--honeycomb") honeycomb = true;
+        else if (arg == "--lod" && hasValue) lodError = (float)atof(argv[++i]);
+        else if (arg[0] != '-' && !cameraPath) cameraPath = argv[i];
+        else {
+            printUsage();
+            return -1;
+        }
+    }
+    if (!cameraPath || width <= 0 || height <= 0 || fps <= 0 || (format != "ppm" && format != "png")) {
+        printUsage();
+        return -1;
+    }
+
+    std::vector<CameraKey> keys;
+    if (!readCameraPath(cameraPath, keys)) return -1;
+    if (!tracePath.empty()) {
+        Profiler::setHistorySize((int)keys.size() + 2);
+        Profiler::setEnabled();
+    }
+
+    SoftwareRasterizer rasterizer(width, height, nThreads);
+    RenderBackend::install(&rasterizer);
+
+    Clock::time_point buildStart = Clock::now();
+    Scene scene;
+    scene.Build();
+    scene.showHoneycomb = honeycomb;
+    scene.lodError = lodError;
+    scene.camera.updateAspectRatio(width, height);
+    printf("Scene built in %.1f ms\n", secondsSince(buildStart) * 1000.0);
+
+    double recordTime = 0, waitTime = 0;
+    std::future<void> pending;
+    Clock::time_point start = Clock::now();
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        Profiler::beginFrame();
+        Clock::time_point recordStart = Clock::now();
+        float t = i / fps;
+        scene.Animate(t, t + 1 / fps);
+        setCurvature(keys[i].curvature);
+        scene.camera.setPosition(keys[i].position);
+        scene.camera.setLookAt(keys[i].lookAt);
+
+        rasterizer.beginFrame();
+        scene.Render();
+        SoftwareFrame frame = rasterizer.endFrame();
+        recordTime += secondsSince(recordStart);
+
+        // only one frame is rasterized at a time, the next one is recorded meanwhile
+        Clock::time_point waitStart = Clock::now();
+        if (pending.valid()) pending.get();
+        waitTime += secondsSince(waitStart);
+
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%05zu.", i);
+        std::string path = outputDir + name + format;
+        pending = std::async(std::launch::async, [&rasterizer, path, frame = std::move(frame)]() {
+            Image image = rasterizer.rasterize(frame);
+            PROFILE_ZONE("Image::write");
+            image.write(path);
+        });
+        Profiler::endFrame();
+    }
+    if (pending.valid()) pending.get();
+
+    double total = secondsSince(start);
+    size_t nFrames = keys.size();
+    printf("Rendered %zu frames (%dx%d) in %.3f s: %.2f fps\n", nFrames, width, height, total, nFrames / total);
+    if (nFrames > 0) {
+        printf("  scene update + vertex stage: %.2f ms/frame\n", recordTime / nFrames * 1000.0);
+        printf("  waiting for rasterization:   %.2f ms/frame\n", waitTime / nFrames * 1000.0);
+    }
+    if (!tracePath.empty() && Profiler::exportChromeTrace(tracePath)) printf("Trace written to %s\n", tracePath.c_str());
+    return 0;
+}
@@ -0,0 +1,768 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include "nonEuclideanMath.h"
+#include "batchTransform.h"
+#include "geometry.h"
+#include "parallel.h"
+#include "renderBackend.h"
+#include "spatialIndex.h"
+#include "objectStore.h"
+#include "textureData.h"
+#include "honeycomb.h"
+
+// Microbenchmarks of the hot paths. Runs every section, or the ones named on
+// the command line:
+//     benchmarks [section ...] [-n repetitions] [--check]
+// Timings are the best of the repetitions. --check only runs the accuracy
+// checks; the exit code is nonzero if any of them fails.
+
+typedef std::chrono::steady_clock Clock;
+
+int repetitions = 5;
+bool checkOnly = false;
+volatile float sink; // keeps the measured results alive
+
+// Best time of func() over the repetitions, divided by count
+template<class Func> double nanosecondsPer(size_t count, Func&& func) {
+    double best = 1e30;
+    for (int r = 0; r < repetitions; r++) {
+        Clock::time_point start = Clock::now();
+        func();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        if (ns < best) best = ns;
+    }
+    return best / count;
+}
+
+void setSpace(Hyperbolic) { Curvature::setHyperbolic(); }
+void setSpace(Euclidean) { Curvature::setEuclidean(); }
+void setSpace(Spherical) { Curvature::setSpherical(); }
+
+const char* spaceName(float curvature) {
+    return curvature < 0.0f ? "hyperbolic" : curvature > 0.0f ? "spherical" : "euclidean";
+}
+
+// Points with euclidean coordinates in the ball of the given radius, uniformly distributed
+std::vector<vec4> randomPoints(size_t n, float radius, unsigned int seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> coordinate(-radius, radius);
+    std::vector<vec4> points;
+    points.reserve(n);
+    while (points.size() < n) {
+        vec4 p(coordinate(generator), coordinate(generator), coordinate(generator), 1.0f);
+        if (p.x * p.x + p.y * p.y + p.z * p.z <= radius * radius) points.push_back(p);
+    }
+    return points;
+}
+
+// Per operation cost of the runtime switched math against the compile-time specialized one
+template<class Space> void benchmarkMathIn(const std::vector<vec4>& euclidean) {
+    setSpace(Space());
+    size_t n = euclidean.size();
+    std::vector<vec4> points(n), vectors(n);
+    for (size_t i = 0; i < n; i++) {
+        points[i] = transformPointToCurrentSpace<Space>(euclidean[i]);
+        vectors[i] = vec4(euclidean[i].y, euclidean[i].z, euclidean[i].x, 0);
+    }
+
+    auto compare = [&](const char* name, auto&& runtime, auto&& specialized) {
+        double tRuntime = nanosecondsPer(n, [&]() {
+            float sum = 0;
+            for (size_t i = 0; i < n; i++) sum += runtime(i);
+            sink = sum;
+        });
+        double tSpecialized = nanosecondsPer(n, [&]() {
+            float sum = 0;
+            for (size_t i = 0; i < n; i++) sum += specialized(i);
+            sink = sum;
+        });
+        printf("  %-10s %-30s %7.2f ns %7.2f ns  %5.2fx\n", spaceName(Space::curvature), name,
+               tRuntime, tSpecialized, tRuntime / tSpecialized);
+    };
+
+    compare("smartDot",
+        [&](size_t i) { return smartDot(points[i], points[(i + 1) % n]); },
+        [&](size_t i) { return smartDot<Space>(points[i], points[(i + 1) % n]); });
+    compare("smartDistance",
+        [&](size_t i) { return smartDistance(points[i], points[(i + 1) % n]); },
+        [&](size_t i) { return smartDistance<Space>(points[i], points[(i + 1) % n]); });
+    compare("smartCross",
+        [&](size_t i) { return smartCross(points[i], vectors[i], vectors[(i + 1) % n]).w; },
+        [&](size_t i) { return smartCross<Space>(points[i], vectors[i], vectors[(i + 1) % n]).w; });
+    compare("TranslateMatrix",
+        [&](size_t i) { return TranslateMatrix(points[i])[0][3]; },
+        [&](size_t i) { return TranslateMatrix<Space>(points[i])[0][3]; });
+    compare("transformPointToCurrentSpace",
+        [&](size_t i) { vec4 p = euclidean[i]; return transformPointToCurrentSpace(p).w; },
+        [&](size_t i) { return transformPointToCurrentSpace<Space>(euclidean[i]).w; });
+    compare("transformVectorToCurrentSpace",
+        [&](size_t i) { return transformVectorToCurrentSpace(vectors[i], points[i]).w; },
+        [&](size_t i) { return transformVectorToCurrentSpace<Space>(vectors[i], points[i]).w; });
+}
+
+bool benchmarkMath() {
+    if (checkOnly) return true;
+    printf("math: runtime switched vs compile-time specialized, per call\n");
+    std::vector<vec4> euclidean = randomPoints(1 << 16, 1.5f, 1);
+    benchmarkMathIn<Hyperbolic>(euclidean);
+    benchmarkMathIn<Euclidean>(euclidean);
+    benchmarkMathIn<Spherical>(euclidean);
+    return true;
+}
+
+// Batch transform against the scalar reference: accuracy and points per second
+template<class Space> bool benchmarkBatchIn(float radius) {
+    const size_t n = 1 << 20;
+    std::vector<vec4> points = randomPoints(n, radius, 2);
+    std::vector<float> x(n), y(n), z(n), reference(4 * n), batch(4 * n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = points[i].x;
+        y[i] = points[i].y;
+        z[i] = points[i].z;
+    }
+
+    transformPointsToCurrentSpaceScalar<Space>(x.data(), y.data(), z.data(), n, reference.data());
+    transformPointsToCurrentSpace<Space>(x.data(), y.data(), z.data(), n, batch.data());
+    // relative to the size of the point, hyperbolic coordinates grow like e^d
+    float maxError = 0;
+    for (size_t i = 0; i < n; i++) {
+        const float* r = &reference[4 * i];
+        float scale = fmaxf(1.0f, fmaxf(fabsf(r[3]), sqrtf(r[0] * r[0] + r[1] * r[1] + r[2] * r[2])));
+        for (int k = 0; k < 4; k++) maxError = fmaxf(maxError, fabsf(batch[4 * i + k] - r[k]) / scale);
+    }
+    const float tolerance = 1e-5f;
+    bool passed = maxError <= tolerance;
+    printf("  %-10s |x| < %-4.1f max relative error %.2e %s\n", spaceName(Space::curvature), radius,
+           maxError, passed ? "ok" : "FAILED");
+    if (checkOnly) return passed;
+
+    setSpace(Space());
+    double tScalar = nanosecondsPer(n, [&]() {
+        transformPointsToCurrentSpaceScalar<Space>(x.data(), y.data(), z.data(), n, reference.data());
+    });
+    double tBatch = nanosecondsPer(n, [&]() {
+        transformPointsToCurrentSpace<Space>(x.data(), y.data(), z.data(), n, batch.data());
+    });
+    double tDispatched = nanosecondsPer(n, [&]() {
+        transformPointsToCurrentSpace(x.data(), y.data(), z.data(), n, batch.data());
+    });
+    printf("  %-10s scalar %7.1f Mpts/s  batch %7.1f Mpts/s  dispatched %7.1f Mpts/s\n", spaceName(Space::curvature),
+           1e3 / tScalar, 1e3 / tBatch, 1e3 / tDispatched);
+    return passed;
+}
+
+bool benchmarkBatch() {
+    printf("batch: transformPointsToCurrentSpace against the scalar transform\n");
+    bool passed = benchmarkBatchIn<Hyperbolic>(6.0f);
+    passed = benchmarkBatchIn<Euclidean>(6.0f) && passed;
+    passed = benchmarkBatchIn<Spherical>(6.0f) && passed;
+    return passed;
+}
+
+// Exposes the vertex packing of ParamGeometry
+struct VertexPacker : ParamGeometry {
+    static size_t size(VertexFormat format) { return vertexSize(format); }
+    static void pack(const VertexData& vertex, VertexFormat format, unsigned char* destination) {
+        packVertex(vertex, format, destination);
+    }
+};
+
+float halfToFloat(unsigned short h) {
+    unsigned int sign = (h & 0x8000u) << 16, exponent = (h >> 10) & 0x1F, mantissa = h & 0x3FF;
+    unsigned int bits;
+    if (exponent == 0) {
+        float f = mantissa * (1.0f / 16777216.0f); // subnormal: mantissa * 2^-24
+        return sign ? -f : f;
+    }
+    if (exponent == 31) bits = sign | 0x7F800000u | (mantissa << 13);
+    else bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// decodeNormal of geom.vert
+vec4 decodeNormal(short ex, short ey) {
+    float x = fmaxf(ex / 32767.0f, -1.0f), y = fmaxf(ey / 32767.0f, -1.0f);
+    vec3 n(x, y, 1.0f - fabsf(x) - fabsf(y));
+    if (n.z < 0.0f) {
+        n.x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    float invLength = 1 / sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+    return vec4(n.x * invLength, n.y * invLength, n.z * invLength, 0);
+}
+
+// What the vertex fetch of geom.vert gets out of a packed vertex
+VertexData unpackVertex(const unsigned char* source, VertexFormat format) {
+    VertexData vertex;
+    if (format == VertexFormat::Float) {
+        memcpy(&vertex, source, sizeof(VertexData));
+    }
+    else if (format == VertexFormat::Compact) {
+        CompactVertexData packed;
+        memcpy(&packed, source, sizeof(packed));
+        vertex.position = vec4(packed.position[0], packed.position[1], packed.position[2], 1);
+        vertex.normal = decodeNormal(packed.normal[0], packed.normal[1]);
+        vertex.texcoord = vec2(packed.texcoord[0] / 65535.0f, packed.texcoord[1] / 65535.0f);
+    }
+    else {
+        HalfVertexData packed;
+        memcpy(&packed, source, sizeof(packed));
+        vertex.position = vec4(halfToFloat(packed.position[0]), halfToFloat(packed.position[1]), halfToFloat(packed.position[2]), 1);
+        vertex.normal = decodeNormal(packed.normal[0], packed.normal[1]);
+        vertex.texcoord = vec2(packed.texcoord[0] / 65535.0f, packed.texcoord[1] / 65535.0f);
+    }
+    return vertex;
+}
+
+// Memory, packing and fetch cost of the vertex layouts on a 512 x 512 sphere. The
+// fetch is timed on the CPU: a streaming read of the buffer plus the decoding
+// geom.vert does, which is bandwidth bound like the GPU's vertex fetch.
+bool benchmarkFormats() {
+    const int N = 512;
+    std::vector<VertexData> vertices;
+    vertices.reserve((N + 1) * (N + 1));
+    for (int i = 0; i <= N; i++) {
+        for (int j = 0; j <= N; j++) {
+            float u = (float)j / N, v = (float)i / N;
+            float phi = u * 2 * (float)M_PI, theta = v * (float)M_PI;
+            VertexData vertex;
+            vertex.normal = vec4(cosf(phi) * sinf(theta), sinf(phi) * sinf(theta), cosf(theta), 0);
+            vertex.position = vertex.normal * 0.5f;
+            vertex.position.w = 1;
+            vertex.texcoord = vec2(u, v);
+            vertices.push_back(vertex);
+        }
+    }
+    size_t n = vertices.size();
+
+    bool passed = true;
+    if (!checkOnly) printf("formats: %dx%d sphere, %zu vertices\n", N, N, n);
+    const VertexFormat formats[] = { VertexFormat::Float, VertexFormat::Compact, VertexFormat::CompactHalf };
+    const char* names[] = { "Float", "Compact", "CompactHalf" };
+    const float tolerances[] = { 0.0f, 1e-3f, 1e-3f }; // largest position, normal or texcoord error
+    for (int f = 0; f < 3; f++) {
+        size_t stride = VertexPacker::size(formats[f]);
+        std::vector<unsigned char> buffer(n * stride);
+        double tPack = nanosecondsPer(n, [&]() {
+            for (size_t i = 0; i < n; i++) VertexPacker::pack(vertices[i], formats[f], &buffer[i * stride]);
+        });
+
+        float maxError = 0;
+        for (size_t i = 0; i < n; i++) {
+            VertexData decoded = unpackVertex(&buffer[i * stride], formats[f]);
+            vec4 dp = decoded.position - vertices[i].position, dn = decoded.normal - vertices[i].normal;
+            vec2 dt = decoded.texcoord - vertices[i].texcoord;
+            float e = fmaxf(fmaxf(fabsf(dp.x), fmaxf(fabsf(dp.y), fabsf(dp.z))), fmaxf(fabsf(dn.x), fmaxf(fabsf(dn.y), fabsf(dn.z))));
+            maxError = fmaxf(maxError, fmaxf(e, fmaxf(fabsf(dt.x), fabsf(dt.y))));
+        }
+        bool ok = maxError <= tolerances[f];
+        passed = passed && ok;
+        if (checkOnly) {
+            printf("  %-12s max decoding error %.2e %s\n", names[f], maxError, ok ? "ok" : "FAILED");
+            continue;
+        }
+
+        double tFetch = nanosecondsPer(n, [&]() {
+            float sum = 0;
+            for (size_t i = 0; i < n; i++) {
+                VertexData vertex = unpackVertex(&buffer[i * stride], formats[f]);
+                sum += vertex.position.x + vertex.normal.y + vertex.texcoord.x;
+            }
+            sink = sum;
+        });
+        printf("  %-12s %2zu bytes/vertex %6.2f MB  pack %5.2f ns/vertex  fetch %5.2f ns/vertex %6.2f GB/s  error %.1e %s\n",
+               names[f], stride, n * stride / 1e6, tPack, tFetch, stride / tFetch, maxError, ok ? "ok" : "FAILED");
+    }
+    return passed;
+}
+
+// Keeps the last tessellated mesh, so ParamGeometry can be built without a GL context
+struct TessellationBackend : RenderBackend {
+    std::vector<VertexData> vertices;
+    unsigned int createMesh(std::vector<VertexData>&& meshVertices, std::vector<unsigned int>&& indices) override {
+        vertices = std::move(meshVertices);
+        return 1;
+    }
+    void deleteMesh(unsigned int mesh) override {}
+    unsigned int createTexture(int width, int height, const std::vector<vec4>& image, int sampling) override { return 0; }
+    void deleteTexture(unsigned int texture) override {}
+    void bind(const RenderState& state) override {}
+    void drawMesh(unsigned int mesh, unsigned int nIndices) override {}
+};
+
+struct BenchSphere : ParamGeometry {
+    void eval(Dnum2& U, Dnum2& V, Dnum2& X, Dnum2& Y, Dnum2& Z) override {
+        U = U * 2.0f * (float)M_PI, V = V * (float)M_PI;
+        X = Cos(U) * Sin(V); Y = Sin(U) * Sin(V); Z = Cos(V);
+    }
+};
+
+// ParamGeometry::create of a 512 x 512 sphere on 1 to N threads, and the cost of
+// an empty parallelFor. The threaded meshes have to match the serial one bit by bit.
+bool benchmarkTessellation() {
+    const int N = 512;
+    TessellationBackend backend;
+    RenderBackend::install(&backend);
+    unsigned int savedThreads = ParamGeometry::tessellationThreads;
+
+    std::vector<unsigned int> threadCounts;
+    unsigned int maxThreads = std::max(hardwareThreadCount(), 2u);
+    for (unsigned int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
+
+    if (!checkOnly) printf("tessellation: %dx%d sphere, %u cores\n", N, N, hardwareThreadCount());
+    bool passed = true;
+    std::vector<VertexData> serial;
+    double tSerial = 0;
+    for (unsigned int nThreads : threadCounts) {
+        ParamGeometry::tessellationThreads = nThreads;
+        BenchSphere sphere;
+        double t = checkOnly ? 0 : nanosecondsPer(1, [&]() { sphere.create(N, N); });
+        if (checkOnly) sphere.create(N, N);
+        if (nThreads == 1) {
+            serial = backend.vertices;
+            tSerial = t;
+        }
+        bool identical = serial.size() == backend.vertices.size() &&
+            memcmp(serial.data(), backend.vertices.data(), serial.size() * sizeof(VertexData)) == 0;
+        passed = passed && identical;
+        if (checkOnly) printf("  %2u threads: %s\n", nThreads, identical ? "identical to serial" : "DIFFERS from serial");
+        else printf("  %2u threads %8.2f ms  speedup %5.2fx  %s\n", nThreads, t * 1e-6, tSerial / t, identical ? "identical" : "DIFFERS");
+    }
+
+    if (!checkOnly) {
+        const int calls = 1000;
+        unsigned int nThreads = maxThreads;
+        double tCall = nanosecondsPer(calls, [&]() {
+            for (int c = 0; c < calls; c++) parallelFor((int)nThreads, [](int i) { sink = (float)i; }, nThreads);
+        });
+        printf("  parallelFor on %u threads, %d items: %.2f us per call, %u pool workers\n",
+               nThreads, (int)nThreads, tCall * 1e-3, ThreadPool::shared().workerCount());
+    }
+
+    ParamGeometry::tessellationThreads = savedThreads;
+    RenderBackend::install(nullptr);
+    return passed;
+}
+
+// Balls of random radii scattered in the current space
+template<class Space> std::vector<SpatialIndex::Ball> randomBalls(size_t n, float spread, float maxRadius, unsigned int seed) {
+    std::vector<vec4> points = randomPoints(n, spread, seed);
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> radius(0.1f * maxRadius, maxRadius);
+    std::vector<SpatialIndex::Ball> balls(n);
+    for (size_t i = 0; i < n; i++) balls[i] = { transformPointToCurrentSpace<Space>(points[i]), radius(generator) };
+    return balls;
+}
+
+// The index has to find what a linear scan finds, up to rounding at the edge of the range
+template<class Space> bool checkIndex(const SpatialIndex& index, const std::vector<SpatialIndex::Ball>& balls,
+                                      const std::vector<vec4>& queries, float range) {
+    const float tolerance = 1e-4f;
+    std::vector<int> found;
+    std::vector<std::pair<float, int>> scan;
+    for (const vec4& query : queries) {
+        scan.clear();
+        for (size_t i = 0; i < balls.size(); i++) {
+            if (index.contains((int)i)) scan.push_back({ smartDistance<Space>(query, balls[i].center) - balls[i].radius, (int)i });
+        }
+        found.clear();
+        index.queryRange(query, range, found);
+        std::vector<bool> inRange(balls.size(), false);
+        for (int id : found) inRange[id] = true;
+        for (const std::pair<float, int>& entry : scan) {
+            if (inRange[entry.second] != (entry.first <= range) && fabsf(entry.first - range) > tolerance) return false;
+        }
+
+        const int k = 10;
+        found.clear();
+        index.queryNearest(query, k, found);
+        std::sort(scan.begin(), scan.end());
+        if (found.size() != std::min((size_t)k, scan.size())) return false;
+        for (size_t j = 0; j < found.size(); j++) {
+            float d = smartDistance<Space>(query, balls[found[j]].center) - balls[found[j]].radius;
+            if (fabsf(d - scan[j].first) > tolerance) return false;
+        }
+    }
+    return true;
+}
+
+// SpatialIndex against the linear scan: range and nearest queries after building, after
+// moving a tenth of the balls and after removing some; and the time of a range query
+template<class Space> bool benchmarkIndexIn(float spread, float range) {
+    setSpace(Space());
+    const size_t n = 1 << 14;
+    std::vector<SpatialIndex::Ball> balls = randomBalls<Space>(n, spread, 0.05f * spread, 3);
+    std::vector<SpatialIndex::Ball> moved = randomBalls<Space>(n / 10, spread, 0.05f * spread, 4);
+    std::vector<vec4> queries;
+    for (const SpatialIndex::Ball& ball : randomBalls<Space>(100, spread, 1.0f, 5)) queries.push_back(ball.center);
+
+    SpatialIndex index;
+    index.build(Space::curvature, balls);
+    bool built = checkIndex<Space>(index, balls, queries, range);
+    for (size_t i = 0; i < moved.size(); i++) {
+        balls[i * 10] = moved[i];
+        index.update((int)i * 10, moved[i]);
+    }
+    bool updated = checkIndex<Space>(index, balls, queries, range);
+    for (size_t i = 0; i < n; i += 3) index.remove((int)i);
+    bool removed = checkIndex<Space>(index, balls, queries, range) && index.size() == (int)(n - (n + 2) / 3);
+    bool passed = built && updated && removed;
+    printf("  %-10s %zu balls: built %s  updated %s  removed %s\n", spaceName(Space::curvature), n,
+           built ? "ok" : "FAILED", updated ? "ok" : "FAILED", removed ? "ok" : "FAILED");
+    if (checkOnly) return passed;
+
+    index.build(Space::curvature, balls);
+    size_t nFound = 0;
+    double tScan = nanosecondsPer(queries.size(), [&]() {
+        size_t count = 0;
+        for (const vec4& query : queries) {
+            for (const SpatialIndex::Ball& ball : balls) count += smartDistance<Space>(query, ball.center) - ball.radius <= range;
+        }
+        nFound = count;
+    });
+    std::vector<int> found;
+    double tIndex = nanosecondsPer(queries.size(), [&]() {
+        found.clear();
+        for (const vec4& query : queries) index.queryRange(query, range, found);
+    });
+    double tBuild = nanosecondsPer(1, [&]() { index.build(Space::curvature, balls); });
+    printf("  %-10s range %.2f, %5.1f found: scan %8.2f us  index %7.2f us  %6.1fx  build %6.2f ms\n",
+           spaceName(Space::curvature), range, (double)nFound / queries.size(), tScan * 1e-3, tIndex * 1e-3,
+           tScan / tIndex, tBuild * 1e-6);
+    return passed;
+}
+
+bool benchmarkIndex() {
+    printf("index: SpatialIndex against a linear scan of smartDistance\n");
+    bool passed = benchmarkIndexIn<Hyperbolic>(4.0f, 0.5f);
+    passed = benchmarkIndexIn<Euclidean>(40.0f, 4.0f) && passed;
+    passed = benchmarkIndexIn<Spherical>(3.0f, 0.2f) && passed;
+    return passed;
+}
+
+// The systems of ObjectStore on 100k objects: animation, transforms and instance data per
+// object, and sorting by render key, which has to keep the components of an object together
+bool benchmarkStore() {
+    const size_t n = 100000;
+    BenchSphere geometries[4];
+    Material materials[2];
+    ObjectStore objects;
+    objects.reserve(n);
+    std::vector<vec4> points = randomPoints(n, 3.0f, 6);
+    std::mt19937 generator(7);
+    for (size_t i = 0; i < n; i++) {
+        size_t object = objects.add({ nullptr, &geometries[generator() % 4], &materials[generator() % 2], nullptr });
+        objects.translation[object] = points[i];
+        objects.spin[object] = (float)i;
+    }
+    objects.sortByRenderKey();
+
+    // every object once, with its own components; each render key in one run, in the order of adding
+    bool passed = objects.size() == n;
+    std::vector<bool> seen(n, false);
+    std::vector<std::pair<Geometry*, Material*>> runs;
+    for (size_t i = 0; i < objects.size() && passed; i++) {
+        size_t original = (size_t)objects.spin[i];
+        passed = original < n && !seen[original] && memcmp(&objects.translation[i], &points[original], sizeof(vec4)) == 0;
+        seen[original] = true;
+        std::pair<Geometry*, Material*> key(objects.renderKey[i].geometry, objects.renderKey[i].material);
+        if (i > 0 && key == runs.back()) passed = passed && objects.spin[i - 1] < objects.spin[i];
+        else if (std::find(runs.begin(), runs.end(), key) != runs.end()) passed = false;
+        else runs.push_back(key);
+    }
+    printf("store: %zu objects sorted by render key %s\n", n, passed ? "ok" : "FAILED");
+    if (checkOnly) return passed;
+
+    double tAnimate = nanosecondsPer(n, [&]() { objects.animate(0.0f, 1e-6f); });
+    double tSort = nanosecondsPer(n, [&]() { objects.sortByRenderKey(); });
+    std::vector<int> updated;
+    updated.reserve(n);
+    // every transform is computed again in another space, none if nothing changed
+    size_t nUpdated = 0;
+    double tChanged = nanosecondsPer(n, [&]() {
+        updated.clear();
+        objects.updateTransforms<Hyperbolic>(updated);
+        objects.updateTransforms<Euclidean>(updated);
+        nUpdated = updated.size();
+    }) / 2;
+    double tStatic = nanosecondsPer(n, [&]() {
+        updated.clear();
+        objects.updateTransforms<Euclidean>(updated);
+    });
+    std::vector<InstanceData> instances(n);
+    double tInstances = nanosecondsPer(n, [&]() {
+        for (size_t i = 0; i < n; i++) instances[i] = objects.instanceData(i);
+    });
+    printf("  animate %.2f ns/object  sort %.2f ns/object  instance data %.2f ns/object\n", tAnimate, tSort, tInstances);
+    printf("  transforms: all changed %.2f ns/object (%zu updated)  none changed %.2f ns/object (%zu updated)\n",
+           tChanged, nUpdated / 2, tStatic, updated.size());
+    return passed;
+}
+
+// Peak signal to noise ratio of the RGB channels of b against a, in dB
+double psnr(const TextureImage& a, const TextureImage& b) {
+    double squared = 0;
+    for (size_t i = 0; i < a.texels.size(); i++) {
+        if (i % 4 == 3) continue;
+        double d = (double)a.texels[i] - b.texels[i];
+        squared += d * d;
+    }
+    double mse = squared / (a.texels.size() / 4 * 3);
+    return mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+// The 8 bit texture path: BC1 is exact on the two color checkerboards and close on smooth
+// images, the mip chain halves down to 1x1, and .ctex files read back as written
+bool benchmarkTextures() {
+    std::vector<vec4> checker(40 * 40);
+    for (int y = 0; y < 40; y++) for (int x = 0; x < 40; x++) {
+        checker[y * 40 + x] = (x & 1) ^ (y & 1) ? vec4(1, 1, 0, 1) : vec4(0, 0, 1, 1);
+    }
+    TextureImage checkerImage = toTextureImage(40, 40, checker);
+    const int n = 256;
+    std::mt19937 generator(8);
+    std::uniform_int_distribution<int> noise(-4, 4);
+    TextureImage smooth;
+    smooth.width = smooth.height = n;
+    smooth.texels.resize(n * n * 4);
+    for (int y = 0; y < n; y++) for (int x = 0; x < n; x++) {
+        unsigned char* t = &smooth.texels[(y * n + x) * 4];
+        t[0] = (unsigned char)std::min(255, std::max(0, x + noise(generator)));
+        t[1] = (unsigned char)std::min(255, std::max(0, y + noise(generator)));
+        t[2] = (unsigned char)(128 + 127 * sinf(x * 0.05f) * cosf(y * 0.05f));
+        t[3] = 255;
+    }
+
+    std::vector<unsigned char> blocks(bc1Size(n, n));
+    compressBC1(checkerImage, blocks.data());
+    double checkerPsnr = psnr(checkerImage, decompressBC1(blocks.data(), 40, 40));
+    compressBC1(smooth, blocks.data());
+    double smoothPsnr = psnr(smooth, decompressBC1(blocks.data(), n, n));
+
+    CompressedTexture texture = compressTexture(checkerImage), read;
+    const char* path = "benchmark_texture.ctex";
+    bool written = writeCompressedTexture(path, texture) && readCompressedTexture(path, read);
+    remove(path);
+    TextureImage lastLevel = checkerImage;
+    while (lastLevel.width > 1 || lastLevel.height > 1) lastLevel = downsample(lastLevel);
+
+    bool passed = checkerPsnr == INFINITY && smoothPsnr > 32.0 && written &&
+                  texture.levelSizes.size() == 6 && read.data == texture.data && read.levelSizes == texture.levelSizes &&
+                  abs(lastLevel.texels[0] - 128) <= 2 && abs(lastLevel.texels[2] - 128) <= 2; // yellow and blue average
+    printf("textures: BC1 PSNR checkerboard %.1f dB, smooth %.1f dB, %zu mip levels, .ctex %s %s\n",
+           checkerPsnr, smoothPsnr, texture.levelSizes.size(), written ? "read back" : "not read back", passed ? "ok" : "FAILED");
+    if (checkOnly) return passed;
+
+    std::vector<vec4> floats = toVec4Image(smooth);
+    double tConvert = nanosecondsPer(n * n, [&]() { sink = toTextureImage(n, n, floats).texels[7]; });
+    double tCompress = nanosecondsPer(n * n, [&]() { compressBC1(smooth, blocks.data()); });
+    double tMips = nanosecondsPer(n * n, [&]() { sink = compressTexture(smooth).data[0]; });
+    printf("  %dx%d: to RGBA8 %.2f ns/texel  BC1 %.2f ns/texel  BC1 with mips %.2f ns/texel\n", n, n, tConvert, tCompress, tMips);
+    printf("  bytes per texel: RGBA32F 16, RGBA8 with mips %.2f, BC1 with mips %.2f\n",
+           4.0 * 4 / 3, (double)compressTexture(smooth).data.size() / (n * n));
+    return passed;
+}
+
+// A BMP file of the texels, RGBA8 from the bottom row: 24 bit, or 32 bit with the alpha
+// mask of a 56 byte header; topDown stores the rows from the top
+std::vector<unsigned char> makeBMP(const TextureImage& image, int bitsPerTexel, bool topDown) {
+    int bytesPerTexel = bitsPerTexel / 8;
+    size_t stride = ((size_t)image.width * bytesPerTexel + 3) & ~(size_t)3;
+    uint32_t infoSize = bitsPerTexel == 32 ? 56 : 40, offset = 14 + infoSize;
+    std::vector<unsigned char> file(offset + stride * image.height);
+    auto put = [&](size_t at, uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) file[at + i] = (unsigned char)(value >> (8 * i));
+    };
+    file[0] = 'B'; file[1] = 'M';
+    put(2, (uint32_t)file.size(), 4);
+    put(10, offset, 4);
+    put(14, infoSize, 4);
+    put(18, image.width, 4);
+    put(22, topDown ? -image.height : image.height, 4);
+    put(26, 1, 2);
+    put(28, bitsPerTexel, 2);
+    if (bitsPerTexel == 32) {
+        put(30, 3, 4); // BI_BITFIELDS
+        put(54, 0x00FF0000, 4); put(58, 0x0000FF00, 4); put(62, 0x000000FF, 4); put(66, 0xFF000000, 4);
+    }
+    for (int y = 0; y < image.height; y++) {
+        unsigned char* row = &file[offset + stride * (topDown ? image.height - 1 - y : y)];
+        for (int x = 0; x < image.width; x++, row += bytesPerTexel) {
+            const unsigned char* t = &image.texels[((size_t)y * image.width + x) * 4];
+            row[0] = t[2]; row[1] = t[1]; row[2] = t[0];
+            if (bytesPerTexel == 4) row[3] = t[3];
+        }
+    }
+    return file;
+}
+
+bool writeFile(const char* path, const std::vector<unsigned char>& bytes) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return fclose(file) == 0 && ok;
+}
+
+// The mapped BMP loader: padded rows, 32 bit with alpha, rows from the top, and files
+// with broken headers or cut short are refused
+bool benchmarkBMP() {
+    std::mt19937 generator(9);
+    std::uniform_int_distribution<int> byte(0, 255);
+    TextureImage odd; // 3 bytes per row of padding at 24 bit
+    odd.width = 7;
+    odd.height = 5;
+    for (int i = 0; i < odd.width * odd.height * 4; i++) odd.texels.push_back((unsigned char)(i % 4 == 3 ? 255 : byte(generator)));
+    TextureImage alpha = odd;
+    for (size_t i = 3; i < alpha.texels.size(); i += 4) alpha.texels[i] = (unsigned char)byte(generator);
+
+    const char* path = "benchmark_texture.bmp";
+    TextureImage loaded;
+    bool padded = writeFile(path, makeBMP(odd, 24, false)) && loadBMP(path, false, loaded) && loaded.texels == odd.texels;
+    bool bgra = writeFile(path, makeBMP(alpha, 32, true)) && loadBMP(path, false, loaded) && loaded.texels == alpha.texels;
+    std::vector<unsigned char> file = makeBMP(odd, 24, false);
+    file.resize(file.size() - 1);
+    bool refused = writeFile(path, file) && !loadBMP(path, false, loaded);
+    file = makeBMP(odd, 24, false);
+    file[18] = 0; file[19] = 0; file[20] = 1; // 65536 texels wide
+    refused = refused && writeFile(path, file) && !loadBMP(path, false, loaded);
+    file = makeBMP(odd, 24, false);
+    file[28] = 8; // palette
+    refused = refused && writeFile(path, file) && !loadBMP(path, false, loaded);
+    refused = refused && writeFile(path, std::vector<unsigned char>(10, 'B')) && !loadBMP(path, false, loaded);
+
+    bool passed = padded && bgra && refused;
+    printf("bmp: padded rows %s, 32 bit top down %s, invalid files %s %s\n", padded ? "ok" : "wrong", bgra ? "ok" : "wrong",
+           refused ? "refused" : "accepted", passed ? "ok" : "FAILED");
+    if (checkOnly) {
+        remove(path);
+        return passed;
+    }
+
+    const int n = 2048;
+    TextureImage large;
+    large.width = large.height = n;
+    large.texels.resize((size_t)n * n * 4);
+    for (size_t i = 0; i < large.texels.size(); i++) large.texels[i] = (unsigned char)(i * 7);
+    writeFile(path, makeBMP(large, 24, false));
+    double tMapped = nanosecondsPer((size_t)n * n, [&]() { loadBMP(path, false, loaded); sink = loaded.texels[5]; });
+    // reading the file into a buffer first, as the loader did before
+    double tRead = nanosecondsPer((size_t)n * n, [&]() {
+        FILE* file = fopen(path, "rb");
+        std::vector<unsigned char> bytes(14 + 40 + (size_t)n * n * 3);
+        sink = fread(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+        BMPImage bmp;
+        parseBMP(bytes.data(), bytes.size(), path, bmp);
+        loaded.texels.resize((size_t)n * n * 4);
+        convertBMPRows(bmp, false, 0, n, loaded.texels.data());
+    });
+    remove(path);
+    printf("  %dx%d 24 bit: mapped %.2f ns/texel  read into a buffer %.2f ns/texel\n", n, n, tMapped, tRead);
+    return passed;
+}
+
+// Two cells of a honeycomb are at least twice the inradius apart, closer centers are the same cell
+// found twice. Such centers are also less than the inradius apart in their distance from the origin.
+bool distinctCells(const Honeycomb& honeycomb) {
+    std::vector<Honeycomb::Cell> cells = honeycomb.getCells();
+    std::sort(cells.begin(), cells.end(), [](const Honeycomb::Cell& a, const Honeycomb::Cell& b) { return a.distance < b.distance; });
+    float curvature = honeycomb.getCurvature(), inradius = honeycomb.getInradius();
+    // closer than the inradius: cos of the distance above, cosh below, the euclidean square below the limit
+    double limit = curvature < 0.0f ? cosh(inradius) : (curvature > 0.0f ? -cos(inradius) : inradius * inradius);
+    for (size_t i = 0; i < cells.size(); i++) {
+        vec4 a = cells[i].center();
+        for (size_t j = i + 1; j < cells.size() && cells[j].distance - cells[i].distance < inradius; j++) {
+            vec4 b = cells[j].center();
+            double dot = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z, near;
+            if (curvature < 0.0f) near = (double)a.w * b.w - dot;
+            else if (curvature > 0.0f) near = -(dot + (double)a.w * b.w);
+            else near = (double)(a.x - b.x) * (a.x - b.x) + (double)(a.y - b.y) * (a.y - b.y) + (double)(a.z - b.z) * (a.z - b.z);
+            if (near < limit) return false;
+        }
+    }
+    return true;
+}
+
+// Honeycomb::generate: the honeycombs of the sphere have a known number of cells, which are
+// all found within a radius of pi, and the hyperbolic ones are not to have a cell twice
+bool benchmarkHoneycomb() {
+    struct Finite { int p, q, r; size_t cells; };
+    const Finite finite[] = { { 5, 3, 3, 120 }, { 3, 3, 5, 600 }, { 4, 3, 3, 8 } };
+    bool passed = true;
+    Honeycomb honeycomb;
+    for (const Finite& f : finite) {
+        bool ok = honeycomb.generate(f.p, f.q, f.r, 4.0f) && honeycomb.getCells().size() == f.cells && distinctCells(honeycomb);
+        printf("honeycomb: {%d,%d,%d} %zu cells of %zu %s\n", f.p, f.q, f.r, honeycomb.getCells().size(), f.cells, ok ? "ok" : "FAILED");
+        passed = passed && ok;
+    }
+    const int hyperbolic[][3] = { { 4, 3, 5 }, { 5, 3, 4 } };
+    for (const int* h : hyperbolic) {
+        bool ok = honeycomb.generate(h[0], h[1], h[2], 5.0f) && distinctCells(honeycomb);
+        printf("honeycomb: {%d,%d,%d} within 5, %zu cells %s\n", h[0], h[1], h[2], honeycomb.getCells().size(),
+               ok ? "distinct" : "FAILED, some found twice");
+        passed = passed && ok;
+    }
+    if (checkOnly) return passed;
+
+    struct Run { int p, q, r; float radius; };
+    const Run runs[] = { { 4, 3, 5, 6.0f }, { 5, 3, 5, 7.0f } };
+    for (const Run& run : runs) {
+        honeycomb.generate(run.p, run.q, run.r, run.radius);
+        size_t n = honeycomb.getCells().size();
+        double t = nanosecondsPer(n, [&]() { honeycomb.generate(run.p, run.q, run.r, run.radius); });
+        printf("  {%d,%d,%d} within %.0f: %zu cells in %.1f ms, %.0f ns/cell\n", run.p, run.q, run.r, run.radius, n, t * n * 1e-6, t);
+    }
+    return passed;
+}
+
+struct Section {
+    const char* name;
+    std::function<bool()> run;
+};
+
+int main(int argc, char** argv) {
+    std::vector<Section> sections = {
+        { "math", benchmarkMath },
+        { "batch", benchmarkBatch },
+        { "formats", benchmarkFormats },
+        { "tessellation", benchmarkTessellation },
+        { "index", benchmarkIndex },
+        { "store", benchmarkStore },
+        { "textures", benchmarkTextures },
+        { "bmp", benchmarkBMP },
+        { "honeycomb", benchmarkHoneycomb },
+    };
+
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--check") checkOnly = true;
+        else if (arg == "-n" && i + 1 < argc) repetitions = std::max(1, atoi(argv[++i]));
+        else selected.push_back(arg);
+    }
+
+    bool passed = true;
+    for (const std::string& name : selected) {
+        bool known = false;
+        for (const Section& section : sections) known = known || name == section.name;
+        if (!known) {
+            printf("unknown section %s, sections are:", name.c_str());
+            for (const Section& section : sections) printf(" %s", section.name);
+            printf("\n");
+            return -1;
+        }
+    }
+    for (const Section& section : sections) {
+        bool run = selected.empty();
+        for (const std::string& name : selected) run = run || name == section.name;
+        if (run && !section.run()) passed = false;
+    }
+    return passed ? 0 : 1;
+}
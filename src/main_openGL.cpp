@@ -3,7 +3,6 @@
 #include <iostream>
 #include "scene.cpp"
 
-Scene scene;
 int windowWidth = 1200;
 int windowHeight = 800;
 
@@ -22,7 +21,7 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window) {
+void processInput(GLFWwindow* window, Scene& scene) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     
@@ -53,6 +52,33 @@ void processInput(GLFWwindow* window) {
     //teleport to origin
     if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
         scene.camera.setPosition(vec4(0.0, 0.5, 0.5, 1.0));
+
+    // show or hide the regular honeycomb of the space
+    static bool honeycombPressed = false;
+    bool hPressed = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    if (hPressed && !honeycombPressed) scene.showHoneycomb = !scene.showHoneycomb;
+    honeycombPressed = hPressed;
+
+    // start profiling, on the second press export the last frames as a Chrome trace
+    static bool tracePressed = false;
+    bool pPressed = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (pPressed && !tracePressed) {
+        if (!Profiler::isEnabled()) {
+            Profiler::setEnabled();
+            std::cout << "Profiling, press P again to write the trace" << std::endl;
+        }
+        else {
+            Profiler::setEnabled(false);
+            if (Profiler::exportChromeTrace("frame_trace.json")) std::cout << "Frame trace written to frame_trace.json" << std::endl;
+        }
+    }
+    tracePressed = pPressed;
+
+    // GL calls the state cache made and left out in the last frame
+    static bool statsPressed = false;
+    bool gPressed = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (gPressed && !statsPressed) GLStateCache::printStats();
+    statsPressed = gPressed;
 }
 
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
@@ -83,6 +109,75 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
     }
 }
 
+// Builds the scene and renders it until the window is closed
+void run(GLFWwindow* window) {
+    Scene scene;
+
+    // Textures and meshes are made on loader threads and show up as they are uploaded.
+    // Destroyed before the scene, its threads may still be loading into the geometries.
+    ResourceLoader loader((void* (*)(const char*))glfwGetProcAddress);
+    ResourceLoader::install(&loader);
+
+    // Build scene
+    double buildStart = glfwGetTime();
+    scene.Build();
+    scene.camera.updateAspectRatio(windowWidth, windowHeight);
+    printf("Scene built in %.1f ms\n", (glfwGetTime() - buildStart) * 1000);
+    ProgramCache::printStats();
+    bool streaming = true;
+
+    // Animation timing
+    float lastFrame = 0.0f;
+    const float dt = 0.1f;
+
+    // Main render loop
+    while (!glfwWindowShouldClose(window)) {
+        Profiler::beginFrame();
+
+        // Calculate frame timing
+        float currentFrame = glfwGetTime();
+        float deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        // Process input
+        processInput(window, scene);
+
+        // Animation
+        static float tend = 0;
+        float tstart = tend;
+        tend = currentFrame;
+
+        for (float t = tstart; t < tend; t += dt) {
+            float Dt = fmin(dt, tend - t);
+            scene.Animate(t, t + Dt);
+            scene.camera.pan(mouseDeltaX, mouseDeltaY);
+            scene.camera.move(Dt, cameraDirection);
+        }
+
+        // Render
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        
+        Shader::updateHotReload();
+        loader.update();
+        if (streaming && loader.isIdle()) {
+            streaming = false;
+            printf("Resources streamed in %.1f ms, %d uploads of %.1f MB\n", (glfwGetTime() - buildStart) * 1000,
+                   loader.getStats().uploaded, loader.getStats().uploadedBytes / 1048576.0);
+        }
+        scene.Render();
+        GLStateCache::endFrame();
+
+        // Swap buffers and poll events
+        {
+            PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+        glfwPollEvents();
+        Profiler::endFrame();
+    }
+}
+
 int main() {
     //GLFW
     if (!glfwInit()) {
@@ -123,47 +218,16 @@ int main() {
     // Initialize OpenGL state
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
-    
-    // Build scene
-    scene.Build();
-    scene.camera.updateAspectRatio(windowWidth, windowHeight);
-
-    // Animation timing
-    float lastFrame = 0.0f;
-    const float dt = 0.1f;
-
-    // Main render loop
-    while (!glfwWindowShouldClose(window)) {
-        // Calculate frame timing
-        float currentFrame = glfwGetTime();
-        float deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // Process input
-        processInput(window);
-
-        // Animation
-        static float tend = 0;
-        float tstart = tend;
-        tend = currentFrame;
-
-        for (float t = tstart; t < tend; t += dt) {
-            float Dt = fmin(dt, tend - t);
-            scene.Animate(t, t + Dt);
-            scene.camera.pan(mouseDeltaX, mouseDeltaY);
-            scene.camera.move(Dt, cameraDirection);
-        }
+    Profiler::enableGpuTimers();
 
-        // Render
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        scene.Render();
+    // Linked shaders are kept between runs
+    ProgramCache::enable("shader_cache", (void* (*)(const char*))glfwGetProcAddress);
+    
+    // Shaders are compiled again when their files are saved
+    Shader::enableHotReload();
 
-        // Swap buffers and poll events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-    }
+    // The scene and the loader free their GL objects when run returns, while the context is still current
+    run(window);
 
     // Clean up
     glfwTerminate();
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include "textureData.h"
+
+// Offline texture converter: compresses a BMP to BC1 with its whole mip chain, in the
+// .ctex file that Texture::create loads without converting anything.
+//     texture_converter input.bmp output.ctex
+// Prints the sizes and the error of the top level.
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("usage: %s input.bmp output.ctex\n", argv[0]);
+        return -1;
+    }
+
+    TextureImage image;
+    if (!loadBMP(argv[1], false, image) || image.texels.empty()) return 1;
+    CompressedTexture texture = compressTexture(image);
+    if (!writeCompressedTexture(argv[2], texture)) return 1;
+
+    TextureImage decoded = decompressBC1(texture.data.data(), texture.width, texture.height);
+    double squared = 0;
+    for (size_t i = 0; i < image.texels.size(); i++) {
+        if (i % 4 == 3) continue; // BC1 has no alpha
+        double d = (double)image.texels[i] - decoded.texels[i];
+        squared += d * d;
+    }
+    double mse = squared / (image.texels.size() / 4 * 3);
+    size_t rgba32f = (size_t)image.width * image.height * 16;
+    printf("%s: %dx%d, %zu mip levels, %zu bytes (RGBA32F %zu, %.0fx smaller), PSNR %.1f dB\n",
+           argv[2], texture.width, texture.height, texture.levelSizes.size(), texture.data.size(), rgba32f,
+           (double)rgba32f / texture.data.size(), mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : INFINITY);
+    return 0;
+}
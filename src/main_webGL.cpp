@@ -74,6 +74,9 @@ EM_BOOL keyCallback(int eventType, const EmscriptenKeyboardEvent *e, void *userD
        if(e->keyCode == 51) { // 3 key
         Curvature::setSpherical();
        }
+       if(e->keyCode == 72 && !e->repeat) { // H key
+        scene.showHoneycomb = !scene.showHoneycomb;
+       }
     } else if (eventType == EMSCRIPTEN_EVENT_KEYUP) {
         cameraDirection = NONE;
     }
@@ -84,6 +87,8 @@ float lastFrame = 0.0f;
 const float dt = 0.1f;
 
 void main_loop() {
+    Profiler::beginFrame();
+
     // Calculate frame timing
     float currentFrame = emscripten_get_now() / 1000.0f;
     float deltaTime = currentFrame - lastFrame;
@@ -105,7 +110,10 @@ void main_loop() {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
+    ResourceLoader::get()->update();
     scene.Render();
+    GLStateCache::endFrame();
+    Profiler::endFrame();
 }
 
 int main() {
@@ -137,6 +145,10 @@ int main() {
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
 
+    // Textures and meshes show up as they are loaded, a part every frame
+    static ResourceLoader loader;
+    ResourceLoader::install(&loader);
+
     // Build scene
     scene.Build();
     scene.camera.updateAspectRatio(windowWidth, windowHeight);
@@ -151,6 +163,7 @@ int main() {
     printf("[1]: Change to HYPERBOLIC (-1 curvature)\n");
     printf("[2]: Change to EUCLIDEAN (0 curvature)\n");
     printf("[3]: Change to SPHERICAL (1 curvature)\n");
+    printf("[H]: Show/hide the regular honeycomb of the space\n");
     printf("\n");
     printf("[W/A/S/D]: Move around\n");
     printf("[Q/E]: Move up/down\n");
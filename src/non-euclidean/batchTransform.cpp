@@ -0,0 +1,195 @@
+#include "batchTransform.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// The vector kernels are written once against a small set of operations (S::add,
+// S::mul, ...) and instantiated for every instruction set that is compiled in.
+// sin/cos/sinh/cosh are replaced by polynomial approximations with a relative
+// error around 1e-7, which is the precision of the scalar float versions.
+namespace {
+
+template<class S> typename S::V expApprox(typename S::V x) {
+	typedef typename S::V V;
+	x = S::min(x, S::set(88.0f));
+	// exp(x) = 2^n * exp(r), r in [-ln2/2, ln2/2]
+	V n = S::round(S::mul(x, S::set(1.44269504f)));
+	V r = S::sub(x, S::mul(n, S::set(0.693359375f)));
+	r = S::sub(r, S::mul(n, S::set(-2.12194440e-4f)));
+	V p = S::set(1.0f / 720.0f);
+	p = S::add(S::mul(p, r), S::set(1.0f / 120.0f));
+	p = S::add(S::mul(p, r), S::set(1.0f / 24.0f));
+	p = S::add(S::mul(p, r), S::set(1.0f / 6.0f));
+	p = S::add(S::mul(p, r), S::set(0.5f));
+	p = S::add(S::mul(p, r), S::set(1.0f));
+	p = S::add(S::mul(p, r), S::set(1.0f));
+	return S::mul(p, S::pow2(n));
+}
+
+// sin(x)/x and cos(x) on [-pi/4, pi/4]
+template<class S> typename S::V sinOverX(typename S::V r2) {
+	typedef typename S::V V;
+	V p = S::set(1.0f / 362880.0f);
+	p = S::add(S::mul(p, r2), S::set(-1.0f / 5040.0f));
+	p = S::add(S::mul(p, r2), S::set(1.0f / 120.0f));
+	p = S::add(S::mul(p, r2), S::set(-1.0f / 6.0f));
+	return S::add(S::mul(p, r2), S::set(1.0f));
+}
+
+template<class S> typename S::V cosPoly(typename S::V r2) {
+	typedef typename S::V V;
+	V p = S::set(1.0f / 40320.0f);
+	p = S::add(S::mul(p, r2), S::set(-1.0f / 720.0f));
+	p = S::add(S::mul(p, r2), S::set(1.0f / 24.0f));
+	p = S::add(S::mul(p, r2), S::set(-0.5f));
+	return S::add(S::mul(p, r2), S::set(1.0f));
+}
+
+// Computes sin(d)/d and cos(d) (or sinh(d)/d and cosh(d)) for d >= 0.
+template<class S, class Space> void sinCosOverDist(typename S::V d, typename S::V& sinPerDist, typename S::V& cosine) {
+	typedef typename S::V V;
+	if constexpr (Space::curvature < 0.0f) {
+		V e = expApprox<S>(d);
+		V ei = S::div(S::set(1.0f), e);
+		cosine = S::mul(S::add(e, ei), S::set(0.5f));
+		// (e - 1/e) / 2 cancels for small d, the series is exact enough below 1
+		V d2 = S::mul(d, d);
+		V p = S::set(1.0f / 362880.0f);
+		p = S::add(S::mul(p, d2), S::set(1.0f / 5040.0f));
+		p = S::add(S::mul(p, d2), S::set(1.0f / 120.0f));
+		p = S::add(S::mul(p, d2), S::set(1.0f / 6.0f));
+		p = S::add(S::mul(p, d2), S::set(1.0f));
+		V large = S::div(S::mul(S::sub(e, ei), S::set(0.5f)), d);
+		sinPerDist = S::select(S::less(d, S::set(1.0f)), p, large);
+	}
+	else {
+		// d = k * pi/2 + r, the quadrant k selects the sign and which polynomial to use
+		V k = S::round(S::mul(d, S::set(0.636619772f)));
+		V r = S::sub(d, S::mul(k, S::set(1.5703125f)));
+		r = S::sub(r, S::mul(k, S::set(4.83751297e-4f)));
+		r = S::sub(r, S::mul(k, S::set(7.54978995e-8f)));
+		V r2 = S::mul(r, r);
+		V s = S::mul(sinOverX<S>(r2), r);
+		V c = cosPoly<S>(r2);
+		V odd = S::quadrantOdd(k);      // k = 1, 3: sin and cos swap
+		V negSin = S::quadrantNegSin(k); // k = 2, 3
+		V negCos = S::quadrantNegCos(k); // k = 1, 2
+		V sine = S::select(odd, c, s);
+		V cosi = S::select(odd, s, c);
+		sine = S::select(negSin, S::sub(S::set(0.0f), sine), sine);
+		cosi = S::select(negCos, S::sub(S::set(0.0f), cosi), cosi);
+		sinPerDist = S::div(sine, d);
+		cosine = cosi;
+	}
+}
+
+template<class S, class Space>
+size_t transformPointsSimd(const float* x, const float* y, const float* z, size_t n, float* out4) {
+	typedef typename S::V V;
+	size_t i = 0;
+	for (; i + S::width <= n; i += S::width) {
+		V px = S::load(x + i), py = S::load(y + i), pz = S::load(z + i);
+		V dist = S::add(S::sqrt(S::add(S::add(S::mul(px, px), S::mul(py, py)), S::mul(pz, pz))), S::set(0.000001f));
+		V s, c;
+		sinCosOverDist<S, Space>(dist, s, c);
+		S::storeInterleaved(out4 + 4 * i, S::mul(px, s), S::mul(py, s), S::mul(pz, s), c);
+	}
+	return i;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+struct SSE {
+	typedef __m128 V;
+	static const size_t width = 4;
+	static V set(float f) { return _mm_set1_ps(f); }
+	static V load(const float* p) { return _mm_loadu_ps(p); }
+	static V add(V a, V b) { return _mm_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm_div_ps(a, b); }
+	static V min(V a, V b) { return _mm_min_ps(a, b); }
+	static V sqrt(V a) { return _mm_sqrt_ps(a); }
+	static V less(V a, V b) { return _mm_cmplt_ps(a, b); }
+	static V select(V mask, V a, V b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	static V round(V a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+	static V pow2(V n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+	static V quadrantBit(V k, int bits, int value) {
+		__m128i q = _mm_and_si128(_mm_cvtps_epi32(k), _mm_set1_epi32(bits));
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(q, _mm_set1_epi32(value)));
+	}
+	static V quadrantOdd(V k) { return quadrantBit(k, 1, 1); }
+	static V quadrantNegSin(V k) { return quadrantBit(k, 2, 2); }
+	static V quadrantNegCos(V k) { return _mm_or_ps(quadrantBit(k, 3, 1), quadrantBit(k, 3, 2)); }
+	static void storeInterleaved(float* out, V x, V y, V z, V w) {
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(out, x);
+		_mm_storeu_ps(out + 4, y);
+		_mm_storeu_ps(out + 8, z);
+		_mm_storeu_ps(out + 12, w);
+	}
+};
+#endif
+
+#if defined(__AVX2__)
+struct AVX2 {
+	typedef __m256 V;
+	static const size_t width = 8;
+	static V set(float f) { return _mm256_set1_ps(f); }
+	static V load(const float* p) { return _mm256_loadu_ps(p); }
+	static V add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm256_div_ps(a, b); }
+	static V min(V a, V b) { return _mm256_min_ps(a, b); }
+	static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+	static V less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static V select(V mask, V a, V b) { return _mm256_blendv_ps(b, a, mask); }
+	static V round(V a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	static V pow2(V n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+	static V quadrantBit(V k, int bits, int value) {
+		__m256i q = _mm256_and_si256(_mm256_cvtps_epi32(k), _mm256_set1_epi32(bits));
+		return _mm256_castsi256_ps(_mm256_cmpeq_epi32(q, _mm256_set1_epi32(value)));
+	}
+	static V quadrantOdd(V k) { return quadrantBit(k, 1, 1); }
+	static V quadrantNegSin(V k) { return quadrantBit(k, 2, 2); }
+	static V quadrantNegCos(V k) { return _mm256_or_ps(quadrantBit(k, 3, 1), quadrantBit(k, 3, 2)); }
+	static void storeInterleaved(float* out, V x, V y, V z, V w) {
+		V xy0 = _mm256_unpacklo_ps(x, y), xy1 = _mm256_unpackhi_ps(x, y);
+		V zw0 = _mm256_unpacklo_ps(z, w), zw1 = _mm256_unpackhi_ps(z, w);
+		V p04 = _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0));
+		V p15 = _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2));
+		V p26 = _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0));
+		V p37 = _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2));
+		_mm256_storeu_ps(out, _mm256_permute2f128_ps(p04, p15, 0x20));
+		_mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(p26, p37, 0x20));
+		_mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+		_mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+	}
+};
+#endif
+
+} // namespace
+
+template<class Space>
+void transformPointsToCurrentSpace(const float* x, const float* y, const float* z, size_t n, float* out4) {
+	size_t done = 0;
+	if constexpr (Space::curvature != 0.0f) {
+#if defined(__AVX2__)
+		done = transformPointsSimd<AVX2, Space>(x, y, z, n, out4);
+#elif defined(__SSE2__) || defined(_M_X64)
+		done = transformPointsSimd<SSE, Space>(x, y, z, n, out4);
+#endif
+	}
+	transformPointsToCurrentSpaceScalar<Space>(x + done, y + done, z + done, n - done, out4 + 4 * done);
+}
+
+template void transformPointsToCurrentSpace<Hyperbolic>(const float*, const float*, const float*, size_t, float*);
+template void transformPointsToCurrentSpace<Euclidean>(const float*, const float*, const float*, size_t, float*);
+template void transformPointsToCurrentSpace<Spherical>(const float*, const float*, const float*, size_t, float*);
+
+void transformPointsToCurrentSpace(const float* x, const float* y, const float* z, size_t n, float* out4) {
+	dispatchCurvature([&](auto space) {
+		transformPointsToCurrentSpace<decltype(space)>(x, y, z, n, out4);
+	});
+}
@@ -0,0 +1,28 @@
+#ifndef BATCH_TRANSFORM_H
+#define BATCH_TRANSFORM_H
+
+#include <stddef.h>
+#include "nonEuclideanMath.h"
+
+// Batch version of transformPointToCurrentSpace for structure-of-arrays input.
+// x, y, z hold n euclidean points, out4 receives n interleaved (x, y, z, w)
+// points of the current space. Uses AVX2 or SSE2 when the compiler targets
+// them and falls back to the scalar functions otherwise.
+void transformPointsToCurrentSpace(const float* x, const float* y, const float* z, size_t n, float* out4);
+
+template<class Space>
+void transformPointsToCurrentSpace(const float* x, const float* y, const float* z, size_t n, float* out4);
+
+// Reference implementation, one point at a time through the scalar functions.
+template<class Space>
+void transformPointsToCurrentSpaceScalar(const float* x, const float* y, const float* z, size_t n, float* out4) {
+	for (size_t i = 0; i < n; i++) {
+		vec4 p = transformPointToCurrentSpace<Space>(vec4(x[i], y[i], z[i], 1.0f));
+		out4[4 * i + 0] = p.x;
+		out4[4 * i + 1] = p.y;
+		out4[4 * i + 2] = p.z;
+		out4[4 * i + 3] = p.w;
+	}
+}
+
+#endif // BATCH_TRANSFORM_H
@@ -1,6 +1,7 @@
 #include "curvature.h"
 
 float Curvature::curvature = EUC;
+void (*Curvature::changeCallback)(float curvature) = nullptr;
 
 float Curvature::getCurvature()
 {   
@@ -21,12 +22,20 @@ bool Curvature::isEuclidean() {
 
 void Curvature::setHyperbolic() {
     curvature = -1.0f;
+    if (changeCallback) changeCallback(curvature);
 }
 
 void Curvature::setSpherical() {
     curvature =  1.0f;
+    if (changeCallback) changeCallback(curvature);
 }
 
 void Curvature::setEuclidean() {
     curvature =  0.0f;
+    if (changeCallback) changeCallback(curvature);
+}
+
+void Curvature::setChangeCallback(void (*callback)(float curvature)) {
+    changeCallback = callback;
+    if (changeCallback) changeCallback(curvature);
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 class Curvature {
     private:
         static float curvature;
+        static void (*changeCallback)(float curvature);
         
     public:
         static float getCurvature();
@@ -17,6 +18,9 @@ class Curvature {
         static void setHyperbolic();
         static void setSpherical();
         static void setEuclidean();
+        // Called with the curvature by the setters, and once right away. Switches the
+        // shader variants in the scene.
+        static void setChangeCallback(void (*callback)(float curvature));
 };
 
 #endif // GLOBAL_CONSTANTS_H
\ No newline at end of file
@@ -9,6 +9,11 @@ GeomCamera::GeomCamera() {
 
 void GeomCamera::updateAspectRatio(int windowWidth, int windowHeight) {
     asp = (float)windowWidth / windowHeight;
+    viewportHeight = windowHeight;
+}
+
+float GeomCamera::pixelsPerRadian() {
+    return viewportHeight * 0.5f / tanf(fov / 2);
 }
 
 vec4 GeomCamera::getPosition() {
@@ -19,6 +24,11 @@ void GeomCamera::setPosition(vec4 position) {
     eucPosition = position;
 }
 
+void GeomCamera::setLookAt(vec4 direction) {
+    vec3 lookAt3 = euclideanNormalize(vec3(direction.x, direction.y, direction.z));
+    lookAt = vec4(lookAt3.x, lookAt3.y, lookAt3.z, 0);
+}
+
 void GeomCamera::pan(float deltaX, float deltaY){ //x and y are in the range of -1 to 1
     vec3 lookAt3 = vec3(lookAt.x, lookAt.y, lookAt.z);
     vec3 up3 = vec3(up.x, up.y, up.z);
@@ -64,32 +74,32 @@ void GeomCamera::move(float dt, Direction move_direction){
     }
 }
 
-mat4 GeomCamera::V() { // view matrix: translates the center to the origin
-    if (Curvature::isEuclidean()) {
+template<class Space> mat4 GeomCamera::V() { // view matrix: translates the center to the origin
+    if constexpr (Space::curvature == 0.0f) {
         vec3 wVup = vec3(0, 1, 0);
 
         vec3 k_ = euclideanNormalize(vec3(-lookAt.x, -lookAt.y, -lookAt.z));
         vec3 i_ = euclideanNormalize(euclideanCross(wVup, k_));
         vec3 j_ = euclideanNormalize(euclideanCross(k_, i_));
 
-        return TranslateMatrix(eucPosition * oppositeVector()) * mat4(i_.x, j_.x, k_.x, 0,
+        return TranslateMatrix<Space>(eucPosition * oppositeVector()) * mat4(i_.x, j_.x, k_.x, 0,
             i_.y, j_.y, k_.y, 0,
             i_.z, j_.z, k_.z, 0,
             0, 0, 0, 1);
     
     }
     else {
-        vec4 geomPosition = transformPointToCurrentSpace(eucPosition);
+        vec4 geomPosition = transformPointToCurrentSpace<Space>(eucPosition);
 
-        vec4 lookAtTransformed = transformVectorToCurrentSpace(lookAt, geomPosition);
-        vec4 wVup = transformVectorToCurrentSpace(up, geomPosition);
+        vec4 lookAtTransformed = transformVectorToCurrentSpace<Space>(lookAt, geomPosition);
+        vec4 wVup = transformVectorToCurrentSpace<Space>(up, geomPosition);
 
 
-        float alpha = Curvature::getCurvature();
+        constexpr float alpha = Space::curvature;
 
-        vec4 k_ = smartNormalize(-lookAtTransformed);
-        vec4 i_ = smartNormalize(smartCross(geomPosition, wVup, k_)) * alpha;
-        vec4 j_ = smartNormalize(smartCross(geomPosition, k_, i_)) * alpha;
+        vec4 k_ = smartNormalize<Space>(-lookAtTransformed);
+        vec4 i_ = smartNormalize<Space>(smartCross<Space>(geomPosition, wVup, k_)) * alpha;
+        vec4 j_ = smartNormalize<Space>(smartCross<Space>(geomPosition, k_, i_)) * alpha;
 
         return mat4(i_.x, j_.x, k_.x, alpha * geomPosition.x,
             i_.y, j_.y, k_.y, alpha * geomPosition.y,
@@ -99,21 +109,44 @@ mat4 GeomCamera::V() { // view matrix: translates the center to the origin
 
 }
 
-mat4 GeomCamera::P() { // projection matrix: transforms the view frustum to the canonical view volume
-    if (Curvature::isSpherical()) 
-        bp = 3.14f; 
+mat4 GeomCamera::V() {
+    return dispatchCurvature([this](auto space) { return V<decltype(space)>(); });
+}
+
+template<class Space> float GeomCamera::farDistance() {
+    if constexpr (Space::curvature > 0.0f) 
+        return 3.14f; 
     else 
-        bp = 10.f;
+        return 10.f;
+}
+
+float GeomCamera::farDistance() {
+    return dispatchCurvature([this](auto space) { return farDistance<decltype(space)>(); });
+}
+
+// The side planes pass through the eye, at the origin of camera space, so their normals are
+// tangent there (w = 0) and the same in every geometry. The camera looks along -z.
+void GeomCamera::frustumNormals(vec4 normals[4]) {
+    float ty = tanf(fov / 2), tx = ty * asp;
+    vec3 corners[4] = { vec3(tx, ty, -1), vec3(-tx, ty, -1), vec3(-tx, -ty, -1), vec3(tx, -ty, -1) };
+    for (int i = 0; i < 4; i++) {
+        vec3 n = euclideanNormalize(euclideanCross(corners[(i + 1) % 4], corners[i]));
+        normals[i] = vec4(n.x, n.y, n.z, 0);
+    }
+}
+
+template<class Space> mat4 GeomCamera::P() { // projection matrix: transforms the view frustum to the canonical view volume
+    bp = farDistance<Space>();
 
     float A, B;
 
-    if (Curvature::isEuclidean()) {
+    if constexpr (Space::curvature == 0.0f) {
         A = -(fp + bp) / (bp - fp);
         B = -2 *fp*bp / (bp - fp);
     }
     else {
-        A = -smartSin(fp + bp) / smartSin(bp - fp);
-        B = -2 * smartSin(fp)*smartSin(bp) / smartSin(bp - fp);
+        A = -smartSin<Space>(fp + bp) / smartSin<Space>(bp - fp);
+        B = -2 * smartSin<Space>(fp)*smartSin<Space>(bp) / smartSin<Space>(bp - fp);
     }
 
     return mat4(1 / (tan(fov / 2)*asp), 0, 0, 0,
@@ -121,4 +154,18 @@ mat4 GeomCamera::P() { // projection matrix: transforms the view frustum to the
         0, 0, A, -1,
         0, 0, B, 0);
     
-}
\ No newline at end of file
+}
+
+mat4 GeomCamera::P() {
+    return dispatchCurvature([this](auto space) { return P<decltype(space)>(); });
+}
+
+template mat4 GeomCamera::V<Hyperbolic>();
+template mat4 GeomCamera::V<Euclidean>();
+template mat4 GeomCamera::V<Spherical>();
+template mat4 GeomCamera::P<Hyperbolic>();
+template mat4 GeomCamera::P<Euclidean>();
+template mat4 GeomCamera::P<Spherical>();
+template float GeomCamera::farDistance<Hyperbolic>();
+template float GeomCamera::farDistance<Euclidean>();
+template float GeomCamera::farDistance<Spherical>();
@@ -20,16 +20,24 @@ class GeomCamera {
 	vec4 lookAt = vec4(0, 0, -1, 0);
 	vec4 up = vec4(0, 1, 0, 0);
 	float fov, asp, fp, bp;	  
+	int viewportHeight;
 
 public:
     GeomCamera();
     void updateAspectRatio(int windowWidth, int windowHeight);
     vec4 getPosition();
+    float pixelsPerRadian();        // at the center of the viewport
+    float farDistance();            // geodesic distance of the back clipping plane
+    void frustumNormals(vec4 normals[4]); // inward normals of the side planes, in camera space
     void setPosition(vec4 position);
+    void setLookAt(vec4 direction);
     void pan(float deltaX, float deltaY);
     void move(float dt, Direction move_direction);
     mat4 V();
     mat4 P();
+    template<class Space> mat4 V();
+    template<class Space> mat4 P();
+    template<class Space> float farDistance();
 };
 
 #endif // HYPERBOLIC_CAMERA_H
\ No newline at end of file
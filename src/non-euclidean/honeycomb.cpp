@@ -0,0 +1,326 @@
+#include "honeycomb.h"
+#include <stdint.h>
+#include <algorithm>
+#include "profiler.h"
+
+namespace {
+
+struct dvec4 {
+	double v[4];
+};
+
+struct dmat4 { // row-major, points are row vectors as in mat4
+	double m[4][4];
+};
+
+dmat4 identity() {
+	dmat4 result = {};
+	for (int i = 0; i < 4; i++) result.m[i][i] = 1.0;
+	return result;
+}
+
+dmat4 multiply(const dmat4& a, const dmat4& b) {
+	dmat4 result;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			result.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+		}
+	}
+	return result;
+}
+
+dvec4 multiply(const dvec4& v, const dmat4& a) {
+	dvec4 result;
+	for (int j = 0; j < 4; j++) {
+		result.v[j] = v.v[0] * a.m[0][j] + v.v[1] * a.m[1][j] + v.v[2] * a.m[2][j] + v.v[3] * a.m[3][j];
+	}
+	return result;
+}
+
+// The image of the origin under m
+dvec4 centerOf(const dmat4& m) {
+	return { { m.m[3][0], m.m[3][1], m.m[3][2], m.m[3][3] } };
+}
+
+bool nearlyEqual(const dmat4& a, const dmat4& b) {
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			if (fabs(a.m[i][j] - b.m[i][j]) > 1e-9) return false;
+		}
+	}
+	return true;
+}
+
+// The form of the space: x.x + y.y + z.z + metric * w.w
+double formDot(const dvec4& a, const dvec4& b, double metric) {
+	return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] + metric * a.v[3] * b.v[3];
+}
+
+// Reflection x' = x - 2 <x, n> n in the mirror with unit normal n. In euclidean space
+// n.w is the offset of the mirror plane and only the xyz part of n moves the point.
+dmat4 reflection(const dvec4& n, double curvature) {
+	double metric = curvature < 0.0 ? -1.0 : 1.0;
+	double a[4] = { n.v[0], n.v[1], n.v[2], metric * n.v[3] };
+	double b[4] = { n.v[0], n.v[1], n.v[2], curvature == 0.0 ? 0.0 : n.v[3] };
+	dmat4 result = identity();
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) result.m[i][j] -= 2.0 * a[i] * b[j];
+	}
+	return result;
+}
+
+// TranslateMatrix in double precision. It is singular at the antipode of the sphere,
+// which is reached by half a turn along x instead.
+dmat4 translation(const dvec4& p, double curvature) {
+	double x = p.v[0], y = p.v[1], z = p.v[2], w = p.v[3];
+	if (curvature > 0.0 && 1 + w < 1e-9) {
+		dmat4 halfTurn = identity();
+		halfTurn.m[0][0] = halfTurn.m[3][3] = -1.0;
+		return halfTurn;
+	}
+	double a = curvature / (1 + w);
+	dmat4 result = { {
+		{ 1 - a * x * x,    -a * x * y,       -a * x * z,       -curvature * x },
+		{ -a * y * x,       1 - a * y * y,    -a * y * z,       -curvature * y },
+		{ -a * z * x,       -a * z * y,       1 - a * z * z,    -curvature * z },
+		{ x,                y,                z,                w }
+	} };
+	return result;
+}
+
+// Grows with the distance from the origin and is cheaper to evaluate
+double farness(const dvec4& p, double curvature) {
+	if (curvature < 0.0) return p.v[3];
+	if (curvature > 0.0) return -p.v[3];
+	return p.v[0] * p.v[0] + p.v[1] * p.v[1] + p.v[2] * p.v[2];
+}
+
+double distanceFromOrigin(const dvec4& p, double curvature) {
+	if (curvature < 0.0) return acosh(std::max(1.0, p.v[3]));
+	if (curvature > 0.0) return acos(std::min(1.0, std::max(-1.0, p.v[3])));
+	return sqrt(p.v[0] * p.v[0] + p.v[1] * p.v[1] + p.v[2] * p.v[2]);
+}
+
+// Open addressing hash of the cell centers on a grid of the xyz coordinates. Two
+// centers are the same cell if they are much closer than the cells can be. On the
+// sphere the two hemispheres share xyz, so w is compared too. The centers are kept
+// in the slots, a lookup touches one cache line and no other array. Empty slots hold NaN.
+class CenterHash {
+	std::vector<dvec4> slots;
+	double step, tolerance;
+	size_t count = 0;
+
+	static uint64_t hashKey(int64_t x, int64_t y, int64_t z) {
+		uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull ^ (uint64_t)y * 0xC2B2AE3D27D4EB4Full ^ (uint64_t)z * 0x165667B19E3779F9ull;
+		return h ^ (h >> 29);
+	}
+
+	size_t slotOf(int64_t x, int64_t y, int64_t z) const {
+		return (size_t)hashKey(x, y, z) & (slots.size() - 1);
+	}
+
+	void key(const dvec4& p, int64_t k[3]) const {
+		for (int i = 0; i < 3; i++) k[i] = (int64_t)floor(p.v[i] / step);
+	}
+
+	static dvec4 empty() { return { { NAN, NAN, NAN, NAN } }; }
+
+	void place(const dvec4& p) {
+		int64_t k[3];
+		key(p, k);
+		size_t slot = slotOf(k[0], k[1], k[2]);
+		while (used(slots[slot])) slot = (slot + 1) & (slots.size() - 1);
+		slots[slot] = p;
+	}
+
+	static bool used(const dvec4& slot) { return slot.v[0] == slot.v[0]; }
+
+public:
+	CenterHash(double step, size_t expected) : step(step), tolerance(step * 1e-3) {
+		size_t size = 1024;
+		while (size < 2 * expected) size *= 2;
+		slots.assign(size, empty());
+	}
+
+	bool contains(const dvec4& p) const {
+		int64_t k[3];
+		key(p, k);
+		// a center near a grid line may have been stored on the other side of it
+		int other[3];
+		for (int i = 0; i < 3; i++) {
+			double fraction = p.v[i] / step - (double)k[i];
+			other[i] = fraction < 1e-3 ? -1 : (fraction > 1.0 - 1e-3 ? 1 : 0);
+		}
+		for (int corner = 0; corner < 8; corner++) {
+			int64_t probe[3];
+			bool needed = true;
+			for (int i = 0; i < 3; i++) {
+				bool shifted = (corner >> i) & 1;
+				if (shifted && other[i] == 0) needed = false;
+				probe[i] = k[i] + (shifted ? other[i] : 0);
+			}
+			if (!needed) continue;
+			for (size_t slot = slotOf(probe[0], probe[1], probe[2]); used(slots[slot]); slot = (slot + 1) & (slots.size() - 1)) {
+				const dvec4& q = slots[slot];
+				double dx = p.v[0] - q.v[0], dy = p.v[1] - q.v[1], dz = p.v[2] - q.v[2], dw = p.v[3] - q.v[3];
+				if (dx * dx + dy * dy + dz * dz + dw * dw < tolerance * tolerance) return true;
+			}
+		}
+		return false;
+	}
+
+	void insert(const dvec4& p) {
+		if (2 * (count + 1) > slots.size()) {
+			std::vector<dvec4> old(slots.size() * 2, empty());
+			old.swap(slots);
+			for (const dvec4& slot : old) {
+				if (used(slot)) place(slot);
+			}
+		}
+		place(p);
+		count++;
+	}
+};
+
+} // namespace
+
+bool Honeycomb::generate(int p, int q, int r, float radius, size_t maxCells) {
+	PROFILE_ZONE("Honeycomb::generate");
+	cells.clear();
+	if (p < 3 || q < 3 || r < 3 || 1.0 / p + 1.0 / q <= 0.5 || 1.0 / q + 1.0 / r <= 0.5) {
+		printf("{%d,%d,%d} is not a compact regular honeycomb\n", p, q, r);
+		return false;
+	}
+
+	// Mirrors of the fundamental simplex. Mirrors 0, 1 and 2 pass through the cell center
+	// at the origin and generate the symmetries of the cell, mirror 3 holds a face. Their
+	// angles are pi/p, pi/q and pi/r, the other pairs are perpendicular.
+	double cp = cos(M_PI / p), sp = sin(M_PI / p), cq = cos(M_PI / q), cr = cos(M_PI / r);
+	dvec4 n[4];
+	n[0] = { { 1, 0, 0, 0 } };
+	n[1] = { { -cp, sp, 0, 0 } };
+	double y = -cq / sp, z = sqrt(1 - y * y);
+	n[2] = { { 0, y, z, 0 } };
+	double c = -cr / z;
+	// n[3] = (0, 0, c, d) has unit length in the form of the space, which decides the space
+	double k = 0.0, d;
+	if (fabs(c * c - 1) < 1e-9) {
+		d = 0.5;                 // euclidean, cells of unit width
+	}
+	else if (c * c > 1) {
+		k = -1.0;
+		d = sqrt(c * c - 1);
+	}
+	else {
+		k = 1.0;
+		d = sqrt(1 - c * c);
+	}
+	n[3] = { { 0, 0, c, d } };
+	curvature = (float)k;
+	inradius = (float)(k < 0.0 ? asinh(d) : (k > 0.0 ? asin(d) : d));
+
+	// a vertex of the cell lies on mirrors 1, 2 and 3
+	double metric = k < 0.0 ? -1.0 : 1.0;
+	dvec4 vertex;
+	vertex.v[3] = 1.0;
+	vertex.v[2] = -metric * d / c;
+	vertex.v[1] = -z * vertex.v[2] / y;
+	vertex.v[0] = sp * vertex.v[1] / cp;
+	if (k != 0.0) {
+		double norm = sqrt(fabs(formDot(vertex, vertex, metric)));
+		for (int i = 0; i < 4; i++) vertex.v[i] /= norm;
+	}
+	circumradius = (float)distanceFromOrigin(vertex, k);
+
+	dmat4 mirrors[4];
+	for (int i = 0; i < 4; i++) mirrors[i] = reflection(n[i], k);
+
+	// symmetries of the cell: the finite group of mirrors 0, 1 and 2
+	std::vector<dmat4> symmetries(1, identity());
+	for (size_t i = 0; i < symmetries.size(); i++) {
+		for (int m = 0; m < 3; m++) {
+			dmat4 s = multiply(mirrors[m], symmetries[i]);
+			bool known = false;
+			for (const dmat4& t : symmetries) known = known || nearlyEqual(s, t);
+			if (!known) symmetries.push_back(s);
+		}
+	}
+
+	// Reflecting in a face s(face 3) gives the neighbor s^-1 M3 s(cell) = M3 s(cell).
+	// One transform is kept per face, with the neighbor's center.
+	const dvec4 origin = { { 0, 0, 0, 1 } };
+	std::vector<dmat4> faces;
+	std::vector<dvec4> neighbors;
+	double nearest = 1e30;
+	for (const dmat4& s : symmetries) {
+		dmat4 face = multiply(mirrors[3], s);
+		dvec4 neighbor = multiply(origin, face);
+		bool known = false;
+		for (const dvec4& other : neighbors) {
+			double dx = neighbor.v[0] - other.v[0], dy = neighbor.v[1] - other.v[1], dz = neighbor.v[2] - other.v[2], dw = neighbor.v[3] - other.v[3];
+			known = known || dx * dx + dy * dy + dz * dz + dw * dw < 1e-12;
+		}
+		if (known) continue;
+		faces.push_back(face);
+		neighbors.push_back(neighbor);
+		nearest = std::min(nearest, sqrt(neighbor.v[0] * neighbor.v[0] + neighbor.v[1] * neighbor.v[1] + neighbor.v[2] * neighbor.v[2]));
+	}
+
+	// Breadth-first search; a neighbor across face f of cell g is faces[f] * g, its center
+	// neighbors[f] * g. The full transform is only computed for new cells. The cells are
+	// the Voronoi regions of their centers, so the geodesic from a center to the origin
+	// leaves through a face whose neighbor is closer. Hence no cell outside the radius
+	// has to be searched, and every cell is found from a closer one: neighbors closer
+	// than the cell at hand are skipped without looking them up.
+	double limit = k < 0.0 ? cosh(radius) : (k > 0.0 ? -cos(std::min((double)radius, M_PI)) : (double)radius * radius);
+	limit += 1e-9 * fabs(limit);
+	std::vector<dmat4> transforms(1, identity()); // the center of a cell is its last row
+	CenterHash hash(nearest / 2, std::min(maxCells, (size_t)1 << 16));
+	hash.insert(origin);
+	for (size_t i = 0; i < transforms.size() && transforms.size() < maxCells; i++) {
+		double closer = farness(centerOf(transforms[i]), k);
+		closer -= 1e-9 * std::max(1.0, fabs(closer));
+		for (size_t f = 0; f < faces.size(); f++) {
+			dvec4 center = multiply(neighbors[f], transforms[i]);
+			double far = farness(center, k);
+			if (far > limit || far < closer || hash.contains(center)) continue;
+			transforms.push_back(multiply(faces[f], transforms[i]));
+			hash.insert(center);
+			if (transforms.size() >= maxCells) break;
+		}
+	}
+	if (transforms.size() >= maxCells) printf("{%d,%d,%d} stopped at %zu cells\n", p, q, r, maxCells);
+
+	// The transform of a cell is split into a rotation around the origin followed by the
+	// translation to its center, the form geom.vert expects.
+	cells.reserve(transforms.size());
+	for (const dmat4& transform : transforms) {
+		dvec4 center = centerOf(transform);
+		dvec4 back = center;
+		for (int j = 0; j < 3; j++) back.v[j] = -back.v[j];
+		dmat4 rotation = multiply(transform, translation(back, k));
+		dmat4 translate = translation(center, k);
+		Cell cell;
+		cell.Rotate = mat4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+		for (int row = 0; row < 3; row++) {
+			cell.Rotate[row] = vec4((float)rotation.m[row][0], (float)rotation.m[row][1], (float)rotation.m[row][2], 0);
+		}
+		for (int row = 0; row < 4; row++) {
+			cell.Translate[row] = vec4((float)translate.m[row][0], (float)translate.m[row][1], (float)translate.m[row][2], (float)translate.m[row][3]);
+		}
+		cell.distance = (float)distanceFromOrigin(center, k);
+		cells.push_back(cell);
+	}
+	return true;
+}
+
+void Honeycomb::getInstances(float scale, std::vector<InstanceData>& instances) const {
+	mat4 Scale = ScaleMatrix(vec3(scale, scale, scale));
+	mat4 inverseScale = ScaleMatrix(vec3(1 / scale, 1 / scale, 1 / scale));
+	instances.resize(cells.size());
+	for (size_t i = 0; i < cells.size(); i++) {
+		instances[i].ScaleRotate = Scale * cells[i].Rotate;
+		instances[i].Translate = cells[i].Translate;
+		instances[i].Normal = inverseScale * cells[i].Rotate;
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef HONEYCOMB_H
+#define HONEYCOMB_H
+
+#include <vector>
+#include "nonEuclideanMath.h"
+#include "geometry.h"
+
+// Regular honeycomb {p,q,r}: the space is filled with {p,q} polyhedra, r of them around
+// every edge. The cells are enumerated by breadth-first search over the generators of
+// its Coxeter group: the cell at the origin is reflected in its faces, and so are the
+// cells found, as long as their center is within the radius. Every cell is kept once,
+// looked up by its center in a spatial hash. The search runs in double precision.
+//
+// Hyperbolic examples are {4,3,5}, {5,3,4}, {5,3,5} and {3,5,3}, the euclidean one is
+// {4,3,4}, and {3,3,5}, {5,3,3}, {4,3,3}, ... tile the sphere with finitely many cells.
+class Honeycomb {
+public:
+	struct Cell {
+		mat4 Rotate;        // orientation of the cell around its center, a reflection for half of them
+		mat4 Translate;     // TranslateMatrix of the center, also defined at the antipode of the sphere
+		float distance;     // geodesic distance of the center from the origin
+
+		vec4 center() const { return Translate[3]; } // in the space of the honeycomb
+	};
+
+private:
+	std::vector<Cell> cells;  // in breadth-first order, the cell at the origin first
+	float curvature = 0.0f;
+	float inradius = 0.0f;
+	float circumradius = 0.0f;
+
+public:
+	// Builds the cells whose center is within radius of the origin, at most maxCells of them.
+	// Returns false if {p,q,r} is not a compact regular honeycomb, i.e. its cells or vertex
+	// figures are not finite.
+	bool generate(int p, int q, int r, float radius, size_t maxCells = 1 << 21);
+
+	float getCurvature() const { return curvature; }   // of the space the honeycomb fills
+	float getInradius() const { return inradius; }     // geodesic distance of the cell faces from the center
+	float getCircumradius() const { return circumradius; } // and of the cell vertices
+	const std::vector<Cell>& getCells() const { return cells; }
+
+	// Instance attributes placing a geometry modeled around the origin, scaled by scale,
+	// into every cell: the same decomposition the objects of the scene use.
+	void getInstances(float scale, std::vector<InstanceData>& instances) const;
+};
+
+#endif // HONEYCOMB_H
@@ -1,3 +1,7 @@
 # include "curvature.h"
 # include "nonEuclideanMath.h"
-# include "geomCamera.h"
\ No newline at end of file
+# include "geomCamera.h"
+# include "batchTransform.h"
+# include "honeycomb.h"
+# include "spatialIndex.h"
+# include "objectStore.h"
\ No newline at end of file
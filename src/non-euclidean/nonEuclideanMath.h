@@ -39,8 +39,11 @@ inline float smartDistance(vec4 p, vec4 q) {
 		vec4 direction = p - q;
 			return smartLength(direction);
 	}
-	else{
-		return smartArcCos(-smartDot(q, p));
+	else if (Curvature::isHyperbolic()) {
+		return acoshf(fmaxf(1.0f, -smartDot(q, p)));
+	}
+	else {
+		return acosf(fminf(1.0f, fmaxf(-1.0f, smartDot(q, p))));
 	}
 }
 
@@ -104,4 +107,102 @@ inline vec4 transformPointToCurrentSpace(vec4& point) {
 	return vec4(0, 0, 0, 1) * smartCos(dist) + v * smartSin(dist);
 }
 
+// Compile-time specialized variants of the functions above. The geometry is
+// given as a tag type, so every branch on the curvature folds away and the
+// caller only has to pick the space once (see dispatchCurvature).
+struct Hyperbolic { static constexpr float curvature = HYP; };
+struct Euclidean  { static constexpr float curvature = EUC; };
+struct Spherical  { static constexpr float curvature = SPH; };
+
+template<class Space> inline float smartSin(float x) {
+	if constexpr (Space::curvature < 0.0f) return sinhf(x);
+	else return sinf(x);
+}
+
+template<class Space> inline float smartCos(float x) {
+	if constexpr (Space::curvature < 0.0f) return coshf(x);
+	else return cosf(x);
+}
+
+template<class Space> inline float smartArcCos(float x) {
+	if constexpr (Space::curvature < 0.0f) return acoshf(x);
+	else return acosf(x);
+}
+
+template<class Space> inline float smartDot(const vec4& v1, const vec4& v2) {
+	constexpr float lorentzSign = Space::curvature < 0.0f ? -1.0f : 1.0f;
+	return (v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + lorentzSign * v1.w * v2.w);
+}
+
+template<class Space> inline float smartLength(const vec4& v) { return sqrtf(smartDot<Space>(v, v)); }
+
+template<class Space> inline vec4 smartNormalize(const vec4& v) { return v * (1 / smartLength<Space>(v)); }
+
+template<class Space> inline float smartDistance(const vec4& p, const vec4& q) {
+	if constexpr (Space::curvature == 0.0f) return smartLength<Space>(p - q);
+	else if constexpr (Space::curvature < 0.0f) return acoshf(fmaxf(1.0f, -smartDot<Space>(q, p)));
+	else return acosf(fminf(1.0f, fmaxf(-1.0f, smartDot<Space>(q, p))));
+}
+
+template<class Space> inline vec4 smartCross(const vec4& t, const vec4& a, const vec4& b) {
+	constexpr float alpha = Space::curvature;
+	mat3 mx(t.y, t.z, alpha * t.w,
+		a.y, a.z, alpha * a.w,
+		b.y, b.z, alpha * b.w);
+	mat3 my(t.x, t.z, alpha * t.w,
+		a.x, a.z, alpha * a.w,
+		b.x, b.z, alpha * b.w);
+	mat3 mz(t.x, t.y, alpha * t.w,
+		a.x, a.y, alpha * a.w,
+		b.x, b.y, alpha * b.w);
+	mat3 mw(t.x, t.y, t.z,
+		a.x, a.y, a.z,
+		b.x, b.y, b.z);
+	return vec4(det(mx), -det(my), det(mz), -det(mw));
+}
+
+template<class Space> inline mat4 TranslateMatrix(const vec4& position) {
+	constexpr float alpha = Space::curvature;
+	float x = position.x;
+	float y = position.y;
+	float z = position.z;
+	float w = position.w;
+	float a = alpha / (1 + w);
+
+	return mat4(
+		vec4(1 - a * x*x,	-a * x*y,		-a * x*z,		-alpha * x),
+		vec4(-a * y*x,		1 - a * y*y,	-a * y*z,		-alpha * y),
+		vec4(-a * z*x,		-a * z*y,		1 - a * z*z,	-alpha * z),
+		vec4(x,				y,				z,				w));
+}
+
+template<class Space> inline vec4 transformVectorToCurrentSpace(const vec4& vector, const vec4& point) {
+	if constexpr (Space::curvature == 0.0f) return vector;
+	else return vector * TranslateMatrix<Space>(point);
+}
+
+template<class Space> inline vec4 transformPointToCurrentSpace(const vec4& point) {
+	if constexpr (Space::curvature == 0.0f) return point;
+	else {
+		float dist = sqrtf(point.x * point.x + point.y * point.y + point.z * point.z) + 0.000001f;
+		float s = smartSin<Space>(dist) / dist;
+		return vec4(point.x * s, point.y * s, point.z * s, smartCos<Space>(dist));
+	}
+}
+
+// Calls func with the tag of the current geometry. Branches on the curvature
+// once, so hot loops should be placed inside func.
+template<class Func> inline auto dispatchCurvature(Func&& func) {
+	if (Curvature::isHyperbolic()) return func(Hyperbolic());
+	if (Curvature::isSpherical()) return func(Spherical());
+	return func(Euclidean());
+}
+
+// the same for a curvature other than the current one, e.g. the one a draw was recorded in
+template<class Func> inline auto dispatchCurvature(float curvature, Func&& func) {
+	if (curvature < 0.0f) return func(Hyperbolic());
+	if (curvature > 0.0f) return func(Spherical());
+	return func(Euclidean());
+}
+
 #endif // NON_EUCLIDEAN_MATHS_H
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "objectStore.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+template<class T> void permute(std::vector<T>& column, const std::vector<size_t>& order) {
+	std::vector<T> sorted;
+	sorted.reserve(column.size());
+	for (size_t i : order) sorted.push_back(column[i]);
+	column.swap(sorted);
+}
+
+} // namespace
+
+uint64_t ObjectStore::resourceId(const void* resource) {
+	auto found = resourceIds.find(resource);
+	if (found != resourceIds.end()) return found->second;
+	uint64_t id = std::min<uint64_t>(resourceIds.size(), 0xFFFF); // 16 bits in the sort key
+	resourceIds.emplace(resource, id);
+	return id;
+}
+
+void ObjectStore::reserve(size_t n) {
+	sortKeys.reserve(n);
+	transformInputs.reserve(n);
+	transform.reserve(n);
+	translation.reserve(n);
+	rotationAxis.reserve(n);
+	rotationAngle.reserve(n);
+	scale.reserve(n);
+	sphericalScale.reserve(n);
+	renderKey.reserve(n);
+	drawInSphericalSpace.reserve(n);
+	level.reserve(n);
+	spin.reserve(n);
+}
+
+void ObjectStore::clear() {
+	resourceIds.clear();
+	sortKeys.clear();
+	transformInputs.clear();
+	transform.clear();
+	transformsValid = false;
+	translation.clear();
+	rotationAxis.clear();
+	rotationAngle.clear();
+	scale.clear();
+	sphericalScale.clear();
+	renderKey.clear();
+	drawInSphericalSpace.clear();
+	level.clear();
+	spin.clear();
+}
+
+size_t ObjectStore::add(const RenderKey& key) {
+	sortKeys.push_back(resourceId(key.shader) << 48 | resourceId(key.texture) << 32 |
+					   resourceId(key.material) << 16 | resourceId(key.geometry));
+	translation.push_back(vec4(0, 0, 0, 1));
+	rotationAxis.push_back(vec3(0, 0, 1));
+	rotationAngle.push_back(0.0f);
+	scale.push_back(vec3(1, 1, 1));
+	sphericalScale.push_back(vec3(1, 1, 1));
+	transformInputs.emplace_back();
+	transform.emplace_back();
+	transformsValid = false; // computed with all the others on the next update
+	renderKey.push_back(key);
+	drawInSphericalSpace.push_back(1);
+	level.push_back(-1);
+	spin.push_back(0.0f);
+	return size() - 1;
+}
+
+void ObjectStore::sortByRenderKey() {
+	std::vector<size_t> order(size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] < sortKeys[b]; });
+	permute(sortKeys, order);
+	permute(transformInputs, order);
+	permute(transform, order);
+	permute(translation, order);
+	permute(rotationAxis, order);
+	permute(rotationAngle, order);
+	permute(scale, order);
+	permute(sphericalScale, order);
+	permute(renderKey, order);
+	permute(drawInSphericalSpace, order);
+	permute(level, order);
+	permute(spin, order);
+}
+
+void ObjectStore::animate(float tstart, float tend) {
+	float dt = tend - tstart;
+	for (size_t i = 0; i < spin.size(); i++) {
+		if (spin[i] != 0.0f) rotationAngle[i] += spin[i] * dt;
+	}
+}
@@ -0,0 +1,128 @@
+#ifndef OBJECT_STORE_H
+#define OBJECT_STORE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+#include "nonEuclideanMath.h"
+
+// What an object is drawn with
+struct RenderKey {
+	Shader *   shader;
+	Geometry * geometry;
+	Material * material;
+	Texture *  texture;
+};
+
+// Modeling transform of an object, as drawn
+struct ObjectTransform {
+	mat4  ScaleRotate, Translate;
+	mat4  Normal;       // transpose(inverse(ScaleRotate)), for the normals
+	vec4  center;       // the translation in the current space
+	float radius;       // bounding radius
+};
+
+// The objects of a scene as structure of arrays: one column per component, an object is
+// an index into all of them. The systems that run every frame (animation, culling, level
+// selection, instancing) walk only the columns they need.
+//
+// The objects are sorted by render key, see sortByRenderKey, so the ones that share a
+// shader, texture, material and geometry follow each other. Sorting renumbers them.
+class ObjectStore {
+	// what a transform was computed from, it is computed again when any of it changes
+	struct TransformInputs {
+		vec4  translation;
+		vec3  rotationAxis;
+		float rotationAngle;
+		vec3  scale;
+	};
+
+	std::unordered_map<const void*, uint64_t> resourceIds; // in the order first used
+	std::vector<uint64_t> sortKeys;
+	std::vector<TransformInputs> transformInputs;
+	float transformCurvature = 0.0f;
+	bool transformsValid = false;
+
+	uint64_t resourceId(const void* resource);
+
+public:
+	// transform
+	std::vector<vec4>  translation;
+	std::vector<vec3>  rotationAxis;
+	std::vector<float> rotationAngle;
+	std::vector<vec3>  scale;
+	std::vector<vec3>  sphericalScale;          // replaces scale in spherical space
+	std::vector<ObjectTransform> transform;     // as of the last updateTransforms
+	// rendering
+	std::vector<RenderKey>     renderKey;
+	std::vector<unsigned char> drawInSphericalSpace;
+	std::vector<int>           level;           // level of detail of the geometry, -1 while culled
+	// animation
+	std::vector<float> spin;                    // radians per second around the rotation axis
+
+	size_t size() const { return renderKey.size(); }
+	void reserve(size_t n);
+	void clear();
+
+	// A new object at the origin, unrotated and unscaled. Returns its index.
+	size_t add(const RenderKey& key);
+	// Orders the objects by shader, texture, material and geometry, stable otherwise
+	void sortByRenderKey();
+
+	// the animation system
+	void animate(float tstart, float tend);
+
+	// The transform system: computes the transforms of the objects that moved, turned or
+	// were scaled since the last call, or all of them if the space changed. Appends the
+	// indices of the updated objects to updated.
+	template<class Space> void updateTransforms(std::vector<int>& updated);
+	// all of them on the next update, e.g. once the bounding radius of a geometry is known
+	void invalidateTransforms() { transformsValid = false; }
+
+	bool isVisible(size_t i) const {
+		return !Curvature::isSpherical() || drawInSphericalSpace[i];
+	}
+
+	template<class Space> const vec3& getScaleVector(size_t i) const {
+		return Space::curvature > 0.0f ? sphericalScale[i] : scale[i];
+	}
+
+	template<class Space> float getScale(size_t i) const {
+		const vec3& s = getScaleVector<Space>(i);
+		return std::max(fabsf(s.x), std::max(fabsf(s.y), fabsf(s.z)));
+	}
+
+	InstanceData instanceData(size_t i) const {
+		InstanceData instance;
+		instance.ScaleRotate = transform[i].ScaleRotate;
+		instance.Translate = transform[i].Translate;
+		instance.Normal = transform[i].Normal;
+		return instance;
+	}
+};
+
+template<class Space> void ObjectStore::updateTransforms(std::vector<int>& updated) {
+	bool all = !transformsValid || transformCurvature != Space::curvature;
+	transformsValid = true;
+	transformCurvature = Space::curvature;
+	for (size_t i = 0; i < size(); i++) {
+		const vec3& s = getScaleVector<Space>(i);
+		TransformInputs inputs = { translation[i], rotationAxis[i], rotationAngle[i], s };
+		if (!all && memcmp(&inputs, &transformInputs[i], sizeof(inputs)) == 0) continue;
+		transformInputs[i] = inputs;
+
+		ObjectTransform& t = transform[i];
+		mat4 Rotate = RotationMatrix(rotationAngle[i], rotationAxis[i]);
+		t.ScaleRotate = ScaleMatrix(s) * Rotate;
+		// the inverse of a scale times a rotation, transposed
+		t.Normal = ScaleMatrix(vec3(1 / s.x, 1 / s.y, 1 / s.z)) * Rotate;
+		t.center = transformPointToCurrentSpace<Space>(translation[i]);
+		t.Translate = TranslateMatrix<Space>(t.center);
+		// geodesic radius around the center: the exponential map keeps distances from it
+		t.radius = renderKey[i].geometry->boundingRadius() * getScale<Space>(i);
+		updated.push_back((int)i);
+	}
+}
+
+#endif // OBJECT_STORE_H
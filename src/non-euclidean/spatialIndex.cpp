@@ -0,0 +1,223 @@
+#include "spatialIndex.h"
+#include <algorithm>
+#include <queue>
+
+float SpatialIndex::distance(const vec4& p, const vec4& q) const {
+	if (curvature < 0.0f) return smartDistance<Hyperbolic>(p, q);
+	if (curvature > 0.0f) return smartDistance<Spherical>(p, q);
+	return smartDistance<Euclidean>(p, q);
+}
+
+bool SpatialIndex::reaches(const Ball& ball, const vec4& p, float maxDistance) const {
+	float range = ball.radius + maxDistance;
+	if (range < 0.0f) return false;
+	if (curvature < 0.0f) return -smartDot<Hyperbolic>(p, ball.center) <= coshf(range);
+	if (curvature > 0.0f) return range >= (float)M_PI || smartDot<Spherical>(p, ball.center) >= cosf(range);
+	vec4 d = p - ball.center;
+	return smartDot<Euclidean>(d, d) <= range * range;
+}
+
+// The mean of the centers pulled back into the space, and the smallest radius around it
+SpatialIndex::Ball SpatialIndex::boundOf(const std::vector<int>& ids) const {
+	vec4 mean(0, 0, 0, 0);
+	for (int id : ids) mean = mean + balls[id].center;
+	Ball bound;
+	if (curvature < 0.0f) {
+		bound.center = mean * (1 / sqrtf(std::max(-smartDot<Hyperbolic>(mean, mean), 1e-12f)));
+	}
+	else if (curvature > 0.0f) {
+		float length = smartLength<Spherical>(mean);
+		// centers all around the sphere have no mean, any of them does
+		bound.center = length > 1e-3f ? mean * (1 / length) : balls[ids[0]].center;
+	}
+	else {
+		bound.center = mean * (1.0f / ids.size());
+	}
+	bound.radius = 0.0f;
+	for (int id : ids) bound.radius = std::max(bound.radius, distance(bound.center, balls[id].center) + balls[id].radius);
+	return bound;
+}
+
+int SpatialIndex::buildNode(std::vector<int>& ids, int parent) {
+	int node = (int)nodes.size();
+	nodes.emplace_back();
+	nodes[node].parent = parent;
+	nodes[node].bound = boundOf(ids);
+	if (ids.size() > (size_t)leafSize) {
+		split(node, ids);
+		return node;
+	}
+	for (int id : ids) leafOf[id] = node;
+	nodes[node].ids = ids;
+	return node;
+}
+
+// Halves the balls at the median of the coordinate their centers spread the most in
+void SpatialIndex::split(int node, std::vector<int>& ids) {
+	vec4 low = balls[ids[0]].center, high = low;
+	for (int id : ids) {
+		for (int k = 0; k < 4; k++) {
+			low[k] = std::min(low[k], balls[id].center[k]);
+			high[k] = std::max(high[k], balls[id].center[k]);
+		}
+	}
+	int axis = 0;
+	for (int k = 1; k < 4; k++) {
+		if (high[k] - low[k] > high[axis] - low[axis]) axis = k;
+	}
+	size_t half = ids.size() / 2;
+	std::nth_element(ids.begin(), ids.begin() + half, ids.end(), [&](int a, int b) {
+		return balls[a].center[axis] < balls[b].center[axis];
+	});
+	std::vector<int> left(ids.begin(), ids.begin() + half), right(ids.begin() + half, ids.end());
+	int first = buildNode(left, node);
+	int second = buildNode(right, node);
+	nodes[node].children[0] = first;
+	nodes[node].children[1] = second;
+	nodes[node].ids.clear();
+}
+
+// Enlarges the bounds from node up to the root to contain the ball
+void SpatialIndex::grow(int node, const Ball& ball) {
+	for (; node >= 0; node = nodes[node].parent) {
+		Ball& bound = nodes[node].bound;
+		bound.radius = std::max(bound.radius, distance(bound.center, ball.center) + ball.radius);
+	}
+}
+
+void SpatialIndex::clear(float _curvature) {
+	curvature = _curvature;
+	nodes.clear();
+	root = -1;
+	balls.clear();
+	leafOf.clear();
+	count = 0;
+}
+
+void SpatialIndex::build(float _curvature, const std::vector<Ball>& _balls) {
+	clear(_curvature);
+	if (_balls.empty()) return;
+	balls = _balls;
+	leafOf.assign(balls.size(), -1);
+	count = (int)balls.size();
+	std::vector<int> ids(balls.size());
+	for (size_t i = 0; i < ids.size(); i++) ids[i] = (int)i;
+	nodes.reserve(2 * balls.size() / leafSize + 1);
+	root = buildNode(ids, -1);
+}
+
+void SpatialIndex::insert(int id, const Ball& ball) {
+	if (id >= (int)balls.size()) {
+		balls.resize(id + 1);
+		leafOf.resize(id + 1, -1);
+	}
+	remove(id);
+	balls[id] = ball;
+	count++;
+	if (root < 0) {
+		std::vector<int> ids = { id };
+		root = buildNode(ids, -1);
+		return;
+	}
+
+	// down into the child that has to grow the least, or is the nearest
+	int node = root;
+	while (nodes[node].children[0] >= 0) {
+		int best = -1;
+		float bestGrowth = 0.0f, bestDistance = 0.0f;
+		for (int child : nodes[node].children) {
+			float d = distance(nodes[child].bound.center, ball.center);
+			float growth = std::max(d + ball.radius - nodes[child].bound.radius, 0.0f);
+			if (best < 0 || growth < bestGrowth || (growth == bestGrowth && d < bestDistance)) {
+				best = child;
+				bestGrowth = growth;
+				bestDistance = d;
+			}
+		}
+		node = best;
+	}
+	nodes[node].ids.push_back(id);
+	leafOf[id] = node;
+	grow(node, ball);
+	if (nodes[node].ids.size() > 2 * (size_t)leafSize) {
+		std::vector<int> ids = nodes[node].ids;
+		split(node, ids);
+	}
+}
+
+void SpatialIndex::update(int id, const Ball& ball) {
+	if (!contains(id)) {
+		insert(id, ball);
+		return;
+	}
+	int leaf = leafOf[id];
+	const Ball& bound = nodes[leaf].bound;
+	if (distance(bound.center, ball.center) + ball.radius > bound.radius) {
+		insert(id, ball); // left its leaf, find a better one
+		return;
+	}
+	balls[id] = ball;
+	grow(nodes[leaf].parent, ball);
+}
+
+void SpatialIndex::remove(int id) {
+	if (!contains(id)) return;
+	std::vector<int>& ids = nodes[leafOf[id]].ids;
+	ids.erase(std::find(ids.begin(), ids.end(), id));
+	leafOf[id] = -1;
+	if (--count == 0) {
+		nodes.clear();
+		root = -1;
+	}
+}
+
+void SpatialIndex::queryRange(int node, const vec4& point, float maxDistance, std::vector<int>& ids) const {
+	if (!reaches(nodes[node].bound, point, maxDistance)) return;
+	if (nodes[node].children[0] >= 0) {
+		queryRange(nodes[node].children[0], point, maxDistance, ids);
+		queryRange(nodes[node].children[1], point, maxDistance, ids);
+		return;
+	}
+	for (int id : nodes[node].ids) {
+		if (reaches(balls[id], point, maxDistance)) ids.push_back(id);
+	}
+}
+
+void SpatialIndex::queryRange(const vec4& point, float maxDistance, std::vector<int>& ids) const {
+	if (root >= 0) queryRange(root, point, maxDistance, ids);
+}
+
+// Best first: a node is no nearer than the distance to its center less its radius
+void SpatialIndex::queryNearest(const vec4& point, int k, std::vector<int>& ids) const {
+	if (root < 0 || k <= 0) return;
+	typedef std::pair<float, int> Entry; // distance and node or ball
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+	std::priority_queue<Entry> found; // the k nearest so far, the farthest on top
+	open.push(Entry(distance(point, nodes[root].bound.center) - nodes[root].bound.radius, root));
+	while (!open.empty()) {
+		Entry entry = open.top();
+		open.pop();
+		if ((int)found.size() == k && entry.first >= found.top().first) break;
+		const Node& node = nodes[entry.second];
+		if (node.children[0] >= 0) {
+			for (int child : node.children) {
+				open.push(Entry(distance(point, nodes[child].bound.center) - nodes[child].bound.radius, child));
+			}
+			continue;
+		}
+		for (int id : node.ids) {
+			float d = distance(point, balls[id].center) - balls[id].radius;
+			if ((int)found.size() < k) found.push(Entry(d, id));
+			else if (d < found.top().first) {
+				found.pop();
+				found.push(Entry(d, id));
+			}
+		}
+	}
+	size_t first = ids.size();
+	ids.resize(first + found.size());
+	for (size_t i = ids.size(); i > first; i--) {
+		ids[i - 1] = found.top().second;
+		found.pop();
+	}
+}
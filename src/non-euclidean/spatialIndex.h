@@ -0,0 +1,69 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <vector>
+#include "nonEuclideanMath.h"
+
+// Ball tree over geodesic balls of one space: points of the hyperboloid, the sphere or
+// the w = 1 hyperplane in R^4 with a radius. Every node bounds its balls by a ball of
+// the same space, so subtrees are skipped with the triangle inequality of the geodesic
+// distance. Range queries compare dot products in R^4 with cosh or cos of the range,
+// as the distance grows with -smartDot (hyperbolic) and falls with smartDot (spherical).
+//
+// Balls are identified by small non-negative ids, e.g. indices into the objects of a
+// scene. update() moves a ball; the bounds of its old nodes are not shrunk, so after
+// many moves build() gives a tighter tree.
+class SpatialIndex {
+public:
+	struct Ball {
+		vec4 center;
+		float radius;
+	};
+
+private:
+	struct Node {
+		Ball bound;
+		int children[2] = { -1, -1 };   // both -1 for leaves
+		int parent = -1;
+		std::vector<int> ids;           // balls of a leaf
+	};
+
+	float curvature = 0.0f;
+	std::vector<Node> nodes;
+	int root = -1;
+	std::vector<Ball> balls;            // by id
+	std::vector<int> leafOf;            // by id, -1 if not in the index
+	int count = 0;
+
+	float distance(const vec4& p, const vec4& q) const;
+	// whether the ball comes within maxDistance of p, without the inverse functions
+	bool reaches(const Ball& ball, const vec4& p, float maxDistance) const;
+	Ball boundOf(const std::vector<int>& ids) const;
+	int buildNode(std::vector<int>& ids, int parent);
+	void split(int node, std::vector<int>& ids);
+	void grow(int node, const Ball& ball);
+	void queryRange(int node, const vec4& point, float maxDistance, std::vector<int>& ids) const;
+
+public:
+	static const int leafSize = 8;
+
+	// Empties the index and sets the space of the balls to come
+	void clear(float curvature);
+	// Indexes balls[id] for every id, top-down
+	void build(float curvature, const std::vector<Ball>& balls);
+	void insert(int id, const Ball& ball);
+	void update(int id, const Ball& ball);
+	void remove(int id);
+
+	float getCurvature() const { return curvature; }
+	int size() const { return count; }
+	bool contains(int id) const { return id >= 0 && id < (int)leafOf.size() && leafOf[id] >= 0; }
+	const Ball& getBall(int id) const { return balls[id]; }
+
+	// Appends the ids of the balls that come within maxDistance of point
+	void queryRange(const vec4& point, float maxDistance, std::vector<int>& ids) const;
+	// The k balls whose surface is nearest to point, nearest first
+	void queryNearest(const vec4& point, int k, std::vector<int>& ids) const;
+};
+
+#endif // SPATIAL_INDEX_H
@@ -1,50 +1,68 @@
+#include <algorithm>
 #include <iostream>
 #include "framework.h"
 #include "nonEuclidean.h"
 
 class GeomShader : public Shader {
+	struct {
+		UniformHandle ScaleRotateMatrix, NormalMatrix, TranslateMatrix, instanced, octahedralNormals, diffuseTexture;
+		MaterialUniforms material;
+	} uniforms;
+
 public:
 	GeomShader() {
+		uniforms.ScaleRotateMatrix = uniformHandle("ScaleRotateMatrix");
+		uniforms.NormalMatrix = uniformHandle("NormalMatrix");
+		uniforms.TranslateMatrix = uniformHandle("TranslateMatrix");
+		uniforms.instanced = uniformHandle("instanced");
+		uniforms.octahedralNormals = uniformHandle("octahedralNormals");
+		uniforms.diffuseTexture = uniformHandle("diffuseTexture");
+		uniforms.material = MaterialUniforms("material");
 		createShaderFromFiles("src/shaders/geom.vert", "src/shaders/geom.frag");
+		bindUniformBlock("FrameUniforms", frameUniformsBinding);
 	}
 
-	void Bind(RenderState state) {
+	// per-object uniforms only, the per-frame ones come from the FrameUniforms block
+	void Bind(const RenderState& state) {
+		PROFILE_ZONE("GeomShader::Bind");
+		if (RenderBackend* backend = RenderBackend::get()) {
+			backend->bind(state);
+			return;
+		}
+
 		Use();      // make this program run
 		
-		setUniform(Curvature::getCurvature(), "curvature");
-
-		setUniform(state.Scale, "ScaleMatrix");
-		setUniform(state.Rotate, "RotateMatrix");
-		setUniform(state.Translate, "TranslateMatrix");
-		setUniform(state.VP, "VPMatrix");
-
-		setUniform(state.wEye, "wEye");
-
-		setUniform(*state.texture, std::string("diffuseTexture"));
-		setUniformMaterial(state.material, "material");
-
-		setUniform((int)state.lights.size(), "nLights");
-		for (unsigned int i = 0; i < state.lights.size(); i++) {
-			setUniformLight(state.lights[i], std::string("lights[") + std::to_string(i) + std::string("]"));
+		setUniform((int)state.instanced, uniforms.instanced);
+		setUniform((int)(state.vertexFormat != VertexFormat::Float), uniforms.octahedralNormals);
+		if (!state.instanced) {
+			setUniform(state.ScaleRotate, uniforms.ScaleRotateMatrix);
+			setUniform(state.Normal, uniforms.NormalMatrix);
+			setUniform(state.Translate, uniforms.TranslateMatrix);
 		}
+
+		setUniform(*state.texture, uniforms.diffuseTexture);
+		setUniformMaterial(state.material, uniforms.material);
 	}
 };
 
 class CheckerBoardTexture : public Texture {
 public:
 	CheckerBoardTexture(const int width, const int height) : Texture() {
-		std::vector<vec4> image(width * height);
-		const vec4 yellow(1, 1, 0, 1), blue(0, 0, 1, 1);
-		for (int x = 0; x < width; x++) for (int y = 0; y < height; y++) {
-			image[y * width + x] = (x & 1) ^ (y & 1) ? yellow : blue;
-		}
-		create(width, height, image, GL_NEAREST);
+		stream([width, height](TextureImage& texture) {
+			std::vector<vec4> image(width * height);
+			const vec4 yellow(1, 1, 0, 1), blue(0, 0, 1, 1);
+			for (int x = 0; x < width; x++) for (int y = 0; y < height; y++) {
+				image[y * width + x] = (x & 1) ^ (y & 1) ? yellow : blue;
+			}
+			texture = toTextureImage(width, height, image);
+			return true;
+		}, GL_NEAREST);
 	}
 };
 
 class Sphere : public ParamGeometry {
 public:
-	Sphere() { create(); }
+	Sphere() { createLevels(4, 64); }
 	void eval(Dnum2& U, Dnum2& V, Dnum2& X, Dnum2& Y, Dnum2& Z) {
 		U = U * 2.0f * (float)M_PI, V = V * (float)M_PI;
 		X = Cos(U) * Sin(V); Y = Sin(U) * Sin(V); Z = Cos(V);
@@ -60,7 +78,7 @@ private:
 
 public:
 	Plane() { 
-		create(); 
+		createLevels(4, 128); 
 	}
 
 	void eval(Dnum2& U, Dnum2& V, Dnum2& X, Dnum2& Y, Dnum2& Z) override {
@@ -74,79 +92,310 @@ public:
 };
 
 
-struct Object {
-	Shader *   shader;
-	Material * material;
-	Texture *  texture;
-	Geometry * geometry;
+const float lodShadingWeight = 1.0f / 16; // matched to renders of the finest levels
+const int lodLevelStep = 2;               // only every second level is selected, so that objects share them
 
-	vec4 translation = vec4(0, 0, 0, 0);
-	vec3 rotationAxis = vec3(0, 0, 1);
-	vec3 scale = vec3(1, 1, 1);
-	vec3 sph_scale = vec3(1, 1, 1);
-	float rotationAngle = 0;
+// Objects drawn with a single instanced draw
+struct InstanceGroup {
+	RenderKey key;
+	int       level;
+	std::vector<InstanceData> instances;
+};
 
-	bool draw_in_spherical_space = true;
+// A regular honeycomb of one space, drawn as a ball at the center of every cell.
+// Generated when first shown.
+struct HoneycombCells {
+	int p, q, r;
+	float radius;               // cells whose center is this close to the origin
+	bool built = false;
+	Honeycomb honeycomb;
+	InstanceBuffer instances;   // uploaded once, the cells are not culled
+	float ballRadius = 0.0f;
+};
 
-public:
-	Object(
-		Shader * _shader, 
-		Material * _material,
-		Texture * _texture, 
-		Geometry * _geometry
-	) :
-		translation(vec4(0, 0, 0, 1.0)), 
-		rotationAxis(0, 0, 1), 
-		rotationAngle(0), 
-		scale(1, 1, 1) {
-
-		shader = _shader;
-		texture = _texture;
-		material = _material;
-		geometry = _geometry;
-	}
-
-	virtual void SetModelingTransform(mat4& Scale, mat4& Rotate, mat4& Translate) {
-		if(Curvature::isSpherical()){
-			Scale = ScaleMatrix(sph_scale);
-		}else{
-			Scale = ScaleMatrix(scale);
-		}
-		Rotate = RotationMatrix(rotationAngle, rotationAxis);
-		Translate = TranslateMatrix(transformPointToCurrentSpace(translation));
-	}
-
-	void Draw(RenderState state) {
-		if(Curvature::isSpherical() && !draw_in_spherical_space) {
+class Scene {
+	Arena resources;                           // shaders, materials, textures and geometries
+	ObjectStore objects;
+	std::vector<Light> lights;
+	UniformBuffer frameUniformBuffer;
+	SpatialIndex objectIndex;                  // bounding balls of the objects, by index in objects
+	std::vector<int> nearObjects;              // found by the index, reused between frames
+	std::vector<int> updatedObjects;           // whose transform changed this frame
+	std::vector<int> visibleObjects, previousObjects; // left by Cull, ascending, this and the last frame
+	std::vector<InstanceGroup> instanceGroups; // kept between frames to reuse the instance arrays
+	DrawList drawList;                         // of the objects or instance groups, in the order they are drawn
+	HoneycombCells honeycombs[3];              // hyperbolic, euclidean and spherical
+	Shader *   honeycombShader = nullptr;
+	Material * honeycombMaterial = nullptr;
+	Texture *  honeycombTexture = nullptr;
+	Geometry * honeycombGeometry = nullptr;    // of its own, its vaos keep pointing into the instance buffers
+	int loadedGeneration = 0;                  // of the ResourceLoader, when the transforms were last invalidated
+
+	// Brings the transforms of the objects up to date, and the index of their bounding balls.
+	// The index is built again when the space or the objects change, the objects that moved
+	// or were scaled are updated in it.
+	template<class Space> void UpdateTransforms() {
+		PROFILE_ZONE("Scene::UpdateTransforms");
+		updatedObjects.clear();
+		objects.updateTransforms<Space>(updatedObjects);
+		if (objectIndex.getCurvature() != Space::curvature || objectIndex.size() != (int)objects.size()) {
+			std::vector<SpatialIndex::Ball> balls;
+			balls.reserve(objects.size());
+			for (const ObjectTransform& t : objects.transform) balls.push_back({ t.center, t.radius });
+			objectIndex.build(Space::curvature, balls);
 			return;
 		}
-		mat4 Scale, Rotate, Translate;
-		SetModelingTransform(Scale, Rotate, Translate);
-		state.Scale = Scale;	
-		state.Rotate = Rotate;
-		state.Translate = Translate;
-		state.VP = state.V * state.P;
-		state.material = material;
-		state.texture = texture;
-		shader->Bind(state);
-		geometry->Draw();
+		for (int id : updatedObjects) {
+			const ObjectTransform& t = objects.transform[id];
+			const SpatialIndex::Ball& ball = objectIndex.getBall(id);
+			if (memcmp(&ball.center, &t.center, sizeof(vec4)) != 0 || ball.radius != t.radius) objectIndex.update(id, { t.center, t.radius });
+		}
 	}
 
-	virtual void Animate(float tstart, float tend) { }
-};
+	// Keeps the objects whose bounding sphere reaches into the view frustum and is nearer
+	// than the back plane. The index finds the ones near enough. A sphere of radius r is
+	// outside a plane whose unit normal is n if its center c is farther than r behind it:
+	// smartDot(n, c) < -sin(r), the signed distance being measured along the geodesic to
+	// the plane.
+	template<class Space> void Cull(const mat4& V, const vec4& eye) {
+		UpdateTransforms<Space>();
+		PROFILE_ZONE("Scene::Cull");
+		vec4 normals[4];
+		camera.frustumNormals(normals);
+		float farDistance = camera.farDistance<Space>();
+
+		nearObjects.clear();
+		objectIndex.queryRange(eye, farDistance, nearObjects);
+		std::sort(nearObjects.begin(), nearObjects.end()); // drawn in the order of objects
+
+		previousObjects.swap(visibleObjects);
+		visibleObjects.clear();
+		for (int id : nearObjects) {
+			const RenderKey& key = objects.renderKey[id];
+			// streamed resources show up once uploaded
+			bool inside = objects.isVisible(id) && key.geometry->isReady() && key.texture->isReady();
+			const SpatialIndex::Ball& ball = objectIndex.getBall(id);
+
+			// spheres larger than a hemisphere of the spherical space reach every direction
+			if (inside && (Space::curvature <= 0.0f || ball.radius < (float)M_PI / 2)) {
+				vec4 viewCenter = ball.center * V;
+				float reach = Space::curvature == 0.0f ? ball.radius : smartSin<Space>(ball.radius);
+				for (int i = 0; i < 4 && inside; i++) {
+					inside = smartDot<Space>(normals[i], viewCenter) >= -reach;
+				}
+			}
+			if (inside) visibleObjects.push_back(id);
+		}
+		// the level of an object that went out of view gets picked afresh, without hysteresis, when it shows up again
+		for (int id : previousObjects) {
+			if (!std::binary_search(visibleObjects.begin(), visibleObjects.end(), id)) objects.level[id] = -1;
+		}
+	}
+
+	// Picks the coarsest level of the geometry that stays within maxError pixels, or the
+	// default level if maxError is 0. Of the levels only every lodLevelStep-th one and the
+	// finest are candidates, so objects of a geometry fall into a few instance groups. The
+	// error of a level is how far its triangles cut off the surface, plus how much the
+	// curved space bends its edges: modeling space is mapped around the object's center
+	// with the exponential map, which stretches an edge at geodesic radius rho by
+	// sin(rho) / rho and bends it along the circle of radius rho. Light and view directions
+	// are interpolated between the vertices, which errs like an edge bent around the source;
+	// this shows much less than a displaced silhouette, hence lodShadingWeight.
+	template<class Space> void SelectLevel(size_t i, const RenderState& state, float pixelsPerRadian, float maxError) {
+		Geometry * geometry = objects.renderKey[i].geometry;
+		int& level = objects.level[i];
+		if (maxError <= 0.0f) {
+			level = geometry->defaultLevel();
+			return;
+		}
+		vec3 s = objects.getScaleVector<Space>(i);
+		float maxScale = objects.getScale<Space>(i);
+		float radius = objects.transform[i].radius;
+
+		vec4 center = objects.transform[i].center;
+		mat4 toObject = TranslateMatrix<Space>(center * oppositeVector());
+		mat4 unrotate = RotationMatrix(-objects.rotationAngle[i], objects.rotationAxis[i]);
+		vec3 boxMin, boxMax;
+		geometry->boundingBox(boxMin, boxMax);
+		boxMin = vec3(boxMin.x * s.x, boxMin.y * s.y, boxMin.z * s.z);
+		boxMax = vec3(boxMax.x * s.x, boxMax.y * s.y, boxMax.z * s.z);
+		// geodesic distance of a point of the current space from the center and from the scaled bounding box
+		auto distanceFrom = [&](const vec4& point, float& fromCenter, float& fromBox) {
+			vec4 p = point * toObject;
+			vec3 q(p.x, p.y, p.z);
+			float qLength = euclideanLength(q);
+			fromCenter = qLength;
+			if constexpr (Space::curvature > 0.0f) fromCenter = acosf(std::min(1.0f, std::max(-1.0f, p.w)));
+			else if constexpr (Space::curvature < 0.0f) fromCenter = acoshf(std::max(1.0f, p.w));
+			if (qLength > 0.0f) q = q * (fromCenter / qLength); // back to modeling space distances
+			vec4 m = vec4(q.x, q.y, q.z, 0) * unrotate;
+			vec3 outside(std::max(std::max(std::min(boxMin.x, boxMax.x) - m.x, m.x - std::max(boxMin.x, boxMax.x)), 0.0f),
+						 std::max(std::max(std::min(boxMin.y, boxMax.y) - m.y, m.y - std::max(boxMin.y, boxMax.y)), 0.0f),
+						 std::max(std::max(std::min(boxMin.z, boxMax.z) - m.z, m.z - std::max(boxMin.z, boxMax.z)), 0.0f));
+			fromBox = euclideanLength(outside);
+		};
+		// the size of a unit seen from distance d
+		auto apparent = [](float d) {
+			d = std::max(d, 0.05f);
+			return Space::curvature == 0.0f ? d : std::max(fabsf(smartSin<Space>(d)), 0.05f);
+		};
+		float distance, near;
+		distanceFrom(state.eye, distance, near);
+		float nearestSource = near;
+		for (size_t l = 0; l < lights.size() && l < maxLights; l++) {
+			float fromCenter, fromBox;
+			distanceFrom(state.lightPositions[l], fromCenter, fromBox);
+			nearestSource = std::min(nearestSource, fromBox);
+		}
+
+		int finest = geometry->nLevels() - 1;
+		int selected = finest;
+		for (int l = 0; l < finest; l += lodLevelStep) {
+			float h = geometry->levelEdgeLength(l) * maxScale;
+			float shading = h * h / (8 * std::max(nearestSource, h)) * lodShadingWeight;
+			float error = (geometry->levelError(l) * maxScale + shading) / apparent(near);
+			if constexpr (Space::curvature != 0.0f) {
+				for (int k = 1; k <= 4; k++) {
+					float rho = std::min(radius * k / 4, 3.0f);
+					float stretched = h * smartSin<Space>(rho) / rho;
+					float bend = fabsf(stretched * stretched * smartCos<Space>(rho) / smartSin<Space>(rho) - h * h / rho) / 8;
+					error = std::max(error, bend / apparent(std::max(fabsf(rho - distance), near)));
+				}
+			}
+			// switching to a coarser level needs some margin, so the level does not flicker
+			if (error * pixelsPerRadian <= (l < level ? 0.8f * maxError : maxError)) {
+				selected = l;
+				break;
+			}
+		}
+		level = selected;
+	}
+
+	// keyed by the GL state the draw binds
+	void AddDraw(const RenderKey& key, int level, int index) {
+		drawList.add(key.shader->getId(), key.texture->textureId, key.material, key.geometry->levelVertexArray(level), index);
+	}
+
+	// fills in the per-object part of the frame's render state
+	void DrawObject(size_t i, RenderState& state) {
+		PROFILE_ZONE("Scene::DrawObject");
+		const RenderKey& key = objects.renderKey[i];
+		const ObjectTransform& transform = objects.transform[i];
+		state.ScaleRotate = transform.ScaleRotate;
+		state.Normal = transform.Normal;
+		state.Translate = transform.Translate;
+		state.material = key.material;
+		state.texture = key.texture;
+		state.vertexFormat = key.geometry->levelFormat(objects.level[i]);
+		key.shader->Bind(state);
+		key.geometry->Draw(objects.level[i]);
+	}
+
+	// Objects of the same render key and level are drawn together. The objects are sorted
+	// by render key, so the group of the previous object is tried first. The groups are
+	// drawn in the order of their GL state.
+	void RenderInstanced(RenderState& state) {
+		PROFILE_ZONE("Scene::RenderInstanced");
+		for (InstanceGroup& group : instanceGroups) {
+			group.instances.clear();
+		}
+		InstanceGroup * group = nullptr;
+		for (int id : visibleObjects) {
+			const RenderKey& key = objects.renderKey[id];
+			auto matches = [&](const InstanceGroup& candidate) {
+				return candidate.key.shader == key.shader && candidate.key.geometry == key.geometry && candidate.level == objects.level[id] &&
+					candidate.key.material == key.material && candidate.key.texture == key.texture;
+			};
+			if (!group || !matches(*group)) {
+				group = nullptr;
+				for (InstanceGroup& candidate : instanceGroups) {
+					if (matches(candidate)) {
+						group = &candidate;
+						break;
+					}
+				}
+			}
+			if (!group) {
+				instanceGroups.push_back({ key, objects.level[id], {} });
+				group = &instanceGroups.back();
+			}
+			group->instances.push_back(objects.instanceData(id));
+		}
+
+		drawList.clear();
+		for (size_t i = 0; i < instanceGroups.size(); i++) {
+			const InstanceGroup& group = instanceGroups[i];
+			if (!group.instances.empty()) AddDraw(group.key, group.level, (int)i);
+		}
+		drawList.sort();
+
+		state.instanced = true;
+		for (const DrawList::Item& item : drawList) {
+			InstanceGroup& group = instanceGroups[item.index];
+			state.material = group.key.material;
+			state.texture = group.key.texture;
+			state.vertexFormat = group.key.geometry->levelFormat(group.level);
+			group.key.shader->Bind(state);
+			group.key.geometry->DrawInstanced(group.instances, group.level);
+		}
+	}
+
+	void BuildHoneycomb(HoneycombCells& cells) {
+		PROFILE_ZONE("Scene::BuildHoneycomb");
+		cells.built = true;
+		if (!honeycombGeometry) honeycombGeometry = resources.create<Sphere>();
+		if (!cells.honeycomb.generate(cells.p, cells.q, cells.r, cells.radius)) return;
+		cells.ballRadius = cells.honeycomb.getInradius() / 4;
+		std::vector<InstanceData> instances;
+		cells.honeycomb.getInstances(cells.ballRadius, instances);
+		cells.instances.upload(instances);
+	}
+
+	void RenderHoneycomb(RenderState& state) {
+		PROFILE_ZONE("Scene::RenderHoneycomb");
+		float curvature = Curvature::getCurvature();
+		HoneycombCells& cells = honeycombs[curvature < 0.0f ? 0 : (curvature == 0.0f ? 1 : 2)];
+		if (!cells.built) BuildHoneycomb(cells);
+		if (!honeycombGeometry->isReady() || !honeycombTexture->isReady()) return;
+		state.material = honeycombMaterial;
+		state.texture = honeycombTexture;
+		state.vertexFormat = honeycombGeometry->levelFormat(honeycombLevel);
+		if (!RenderBackend::get()) {
+			state.instanced = true;
+			honeycombShader->Bind(state);
+			honeycombGeometry->DrawInstanced(cells.instances, honeycombLevel);
+			return;
+		}
+		state.instanced = false;
+		mat4 Scale = ScaleMatrix(vec3(cells.ballRadius, cells.ballRadius, cells.ballRadius));
+		mat4 inverseScale = ScaleMatrix(vec3(1 / cells.ballRadius, 1 / cells.ballRadius, 1 / cells.ballRadius));
+		for (const Honeycomb::Cell& cell : cells.honeycomb.getCells()) {
+			state.ScaleRotate = Scale * cell.Rotate;
+			state.Normal = inverseScale * cell.Rotate;
+			state.Translate = cell.Translate;
+			honeycombShader->Bind(state);
+			honeycombGeometry->Draw(honeycombLevel);
+		}
+	}
 
-class Scene {
-	std::vector<Object *> objects;
-	std::vector<Light> lights;
 public:
+	bool instancing = true;
+	bool showHoneycomb = false; // {4,3,5}, {4,3,4} or {5,3,3}, whichever fills the current space
+	int honeycombLevel = 2;
+	float lodError = 0.0f;      // in pixels, 0 draws the default level of every geometry
 
 	GeomCamera camera;
 	void Build() {
-		// Shaders
-		Shader * geomShader = new GeomShader();
+		// Shaders, compiled for every geometry, the curvature picks the variant used
+		Curvature::setChangeCallback([](float curvature) {
+			Shader::selectGeometry(curvature < 0.0f ? GeometryVariant::Hyperbolic :
+								   curvature > 0.0f ? GeometryVariant::Spherical : GeometryVariant::Euclidean);
+		});
+		Shader * geomShader = resources.create<GeomShader>();
+		frameUniformBuffer.create(sizeof(FrameUniforms), frameUniformsBinding);
 
 		// Material
-		Material * material = new Material;
+		Material * material = resources.create<Material>();
 		material->kd = vec3(0.5f, 0.1f, 0.1f);
 		material->ks = vec3(0.5, 0.1,  0.1);
 		material->ka = vec3(0.5f, 0.1f, 0.1f);
@@ -154,58 +403,53 @@ public:
 
 
 		// Textures
-		Texture * texture4x4 = new CheckerBoardTexture(4, 4);
-		Texture * texture40x40 = new CheckerBoardTexture(40, 40);
+		Texture * texture4x4 = resources.create<CheckerBoardTexture>(4, 4);
+		Texture * texture40x40 = resources.create<CheckerBoardTexture>(40, 40);
 
 		// Geometries
-		Sphere * sphere_geom = new Sphere();
-		Plane * plane_geom = new Plane();
+		Sphere * sphere_geom = resources.create<Sphere>();
+		Plane * plane_geom = resources.create<Plane>();
 		
 		// Planes grid
 		for (int y = -3; y <= 3; y++) {
 			
 			// horizontal plane
-			Object * plane_obj = new Object(
-				geomShader, 
-				material, 
-				texture40x40, 
-				plane_geom
-			);
+			size_t plane_obj = objects.add({ geomShader, plane_geom, material, texture40x40 });
 			float height = y;  // Use consistent spacing
-			plane_obj->translation = vec4(0.0f, height, 0.0f, 1.0f);
-			plane_obj->scale = vec3(6.0f, 6.0f, 6.0f);
-
-			plane_obj->draw_in_spherical_space = y == 0;
-			plane_obj->sph_scale = vec3(3.14f, 3.14f, 3.14f);
+			objects.translation[plane_obj] = vec4(0.0f, height, 0.0f, 1.0f);
+			objects.scale[plane_obj] = vec3(6.0f, 6.0f, 6.0f);
 
-			objects.push_back(plane_obj);
+			objects.drawInSphericalSpace[plane_obj] = y == 0;
+			objects.sphericalScale[plane_obj] = vec3(3.14f, 3.14f, 3.14f);
 
 			//vertical plane
-			Object * vertical_plane_obj = new Object(
-				geomShader, 
-				material, 
-				texture40x40,
-				plane_geom
-			);
-			vertical_plane_obj->rotationAxis = vec3(0, 0, 1);
-			vertical_plane_obj->rotationAngle = M_PI / 2.0f;
-			vertical_plane_obj->translation = vec4(height, 0.0f, 0.0f, 1.0f);
-			vertical_plane_obj->scale = vec3(6.0f, 6.0f, 6.0f);
-			vertical_plane_obj->draw_in_spherical_space = false;
-			objects.push_back(vertical_plane_obj);
+			size_t vertical_plane_obj = objects.add({ geomShader, plane_geom, material, texture40x40 });
+			objects.rotationAxis[vertical_plane_obj] = vec3(0, 0, 1);
+			objects.rotationAngle[vertical_plane_obj] = M_PI / 2.0f;
+			objects.translation[vertical_plane_obj] = vec4(height, 0.0f, 0.0f, 1.0f);
+			objects.scale[vertical_plane_obj] = vec3(6.0f, 6.0f, 6.0f);
+			objects.drawInSphericalSpace[vertical_plane_obj] = false;
 		
 		}
 		
 		// Grid of spheres
 		for (int i = -1; i <= 1; i++) {
 			for (int j = -1; j <= 1; j++) {
-				Object * sphere_obj = new Object(geomShader, material, texture4x4, sphere_geom);
-				sphere_obj->translation = vec4(i * 1.57f, 0.0f, j * 1.57f, 1.0f);
-				sphere_obj->scale = vec3(0.3f, 0.3f, 0.3f);
-				sphere_obj->sph_scale = vec3(0.3f, 0.3f, 0.3f);
-				objects.push_back(sphere_obj);
+				size_t sphere_obj = objects.add({ geomShader, sphere_geom, material, texture4x4 });
+				objects.translation[sphere_obj] = vec4(i * 1.57f, 0.0f, j * 1.57f, 1.0f);
+				objects.scale[sphere_obj] = vec3(0.3f, 0.3f, 0.3f);
+				objects.sphericalScale[sphere_obj] = vec3(0.3f, 0.3f, 0.3f);
 			}
 		}
+		objects.sortByRenderKey();
+
+		// Honeycombs
+		honeycombShader = geomShader;
+		honeycombMaterial = material;
+		honeycombTexture = texture4x4;
+		honeycombs[0].p = 4; honeycombs[0].q = 3; honeycombs[0].r = 5; honeycombs[0].radius = 4.5f;
+		honeycombs[1].p = 4; honeycombs[1].q = 3; honeycombs[1].r = 4; honeycombs[1].radius = 6.0f;
+		honeycombs[2].p = 5; honeycombs[2].q = 3; honeycombs[2].r = 3; honeycombs[2].radius = (float)M_PI;
 
 		//Lights
 		Light light;
@@ -228,22 +472,62 @@ public:
 	}
 
 	void Render() {
+		PROFILE_ZONE("Scene::Render");
 		RenderState state;
 		state.wEye = camera.getPosition();
-		state.V = camera.V();
-		state.P = camera.P();
-		state.lights = lights;
-		for (auto * obj : objects) {
-			if (dynamic_cast<GeomShader*>(obj->shader)) {
-				obj->Draw(state);
+		{
+			PROFILE_ZONE("GeomCamera::V/P");
+			state.V = camera.V();
+			state.P = camera.P();
+		}
+		state.VP = state.V * state.P;
+		state.lights = lights.data();
+		state.nLights = (int)lights.size();
+		// the bounding radii of geometries that were streamed in since
+		ResourceLoader* loader = ResourceLoader::get();
+		if (loader && loader->getGeneration() != loadedGeneration) {
+			loadedGeneration = loader->getGeneration();
+			objects.invalidateTransforms();
+		}
+
+		dispatchCurvature([&](auto space) {
+			typedef decltype(space) Space;
+			// once per frame instead of for every vertex
+			state.eye = transformPointToCurrentSpace<Space>(state.wEye);
+			for (size_t i = 0; i < lights.size() && i < maxLights; i++) {
+				state.lightPositions[i] = transformPointToCurrentSpace<Space>(lights[i].wLightPos);
+			}
+			Cull<Space>(state.V, state.eye);
+			PROFILE_ZONE("Scene::SelectLevels");
+			float pixelsPerRadian = camera.pixelsPerRadian();
+			for (int id : visibleObjects) {
+				SelectLevel<Space>(id, state, pixelsPerRadian, lodError);
+			}
+		});
+
+		FrameUniforms frame = frameUniforms(state);
+		frameUniformBuffer.update(&frame, sizeof(frame));
+
+		// backends have no instanced path
+		if (instancing && !RenderBackend::get()) {
+			RenderInstanced(state);
+		}
+		else {
+			drawList.clear();
+			for (int id : visibleObjects) {
+				AddDraw(objects.renderKey[id], objects.level[id], id);
+			}
+			drawList.sort();
+			for (const DrawList::Item& item : drawList) {
+				DrawObject(item.index, state);
 			}
 		}
+
+		if (showHoneycomb) RenderHoneycomb(state);
 	}
 
 	void Animate(float tstart, float tend) {
-		for (Object * obj : objects) {
-			obj->Animate(tstart, tend);
-		}
-
+		PROFILE_ZONE("Scene::Animate");
+		objects.animate(tstart, tend);
 	}
 };
@@ -10,35 +10,68 @@ struct Material {
     float shininess, emission;
 };
 
+// per-frame data, uploaded once per frame (FrameUniforms in shader.h), the eye and the
+// light positions are in the current space
+layout(std140, row_major) uniform FrameUniforms {
+    mat4  ViewMatrix;
+    mat4  ProjectionMatrix;
+    mat4  VPMatrix;
+    vec4  wEye;
+    int   nLights;
+    Light lights[8];
+};
+
+// compiled once per geometry, see GeometryVariant in shader.h
+#if defined(GEOMETRY_HYPERBOLIC)
+const float curvature = -1.0;
+#elif defined(GEOMETRY_SPHERICAL)
+const float curvature = 1.0;
+#else
+const float curvature = 0.0;
+#endif
+
 uniform Material material;
-uniform Light[8] lights;    // light sources 
-uniform int   nLights;
 uniform sampler2D diffuseTexture;
 
-uniform float curvature;
-
 in  vec4 wNormal;       // interpolated world sp normal
-in  vec4 wView;         // interpolated world sp view
-in  vec4 wLight[8];     // interpolated world sp illum dir
+in  vec4 wPos;          // interpolated world sp position
 in  vec2 texcoord;
 
 out vec4 fragColor; // output goes to frame buffer
 
 float dotGeom(vec4 u, vec4 v) {
-    float LorentzSign = curvature < 0.0 ? -1.0 : 1.0;
-    return u.x * v.x + u.y * v.y + u.z * v.z + LorentzSign * u.w * v.w;
+#ifdef GEOMETRY_HYPERBOLIC
+    return dot(u.xyz, v.xyz) - u.w * v.w;
+#else
+    return dot(u, v);
+#endif
+}
+
+// back onto the sphere or the hyperboloid, interpolation between the vertices cuts below it
+vec4 toCurrentSpace(vec4 p) {
+    if (curvature == 0.0) return p;
+    return p / sqrt(abs(dotGeom(p, p)));
+}
+
+// Unit tangent at from towards to. The geodesic leaves along to - from * cos(d) in
+// spherical and to - from * cosh(d) in hyperbolic space, normalizing takes care of the
+// sin(d) or sinh(d) it is divided by.
+vec4 direction(vec4 to, vec4 from) {
+    float cosd = curvature == 0.0 ? 1.0 : curvature * dotGeom(from, to);
+    return normalize(to - from * cosd);
 }
 
 void main() {
+    vec4 P = toCurrentSpace(wPos);
     vec4 N = normalize(wNormal);
-    vec4 V = normalize(wView); 
+    vec4 V = direction(wEye, P);
     vec3 texColor = texture(diffuseTexture, texcoord).rgb;
     vec3 ka = material.ka * texColor;
     vec3 kd = material.kd * texColor;
 
     vec3 radiance = texColor * material.emission;
     for(int i = 0; i < nLights; i++) {
-        vec4 L = normalize(wLight[i]);
+        vec4 L = direction(lights[i].wLightPos, P);
         vec4 H = normalize(L + V);
         float cost = max(dotGeom(N, L), 0.0), cosd = max(dotGeom(N, H), 0.0);
         // kd and ka are modulated by the texture
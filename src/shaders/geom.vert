@@ -5,63 +5,56 @@ struct Light {
     vec4 wLightPos;
 };
 
-uniform mat4  ScaleMatrix;
-uniform mat4  RotateMatrix;
-uniform mat4  TranslateMatrix;
-uniform mat4  VPMatrix;
+// per-frame data, uploaded once per frame (FrameUniforms in shader.h), the eye and the
+// light positions are in the current space
+layout(std140, row_major) uniform FrameUniforms {
+    mat4  ViewMatrix;
+    mat4  ProjectionMatrix;
+    mat4  VPMatrix;
+    vec4  wEye;
+    int   nLights;
+    Light lights[8];
+};
 
-uniform float curvature;
+// compiled once per geometry, see GeometryVariant in shader.h
+#if defined(GEOMETRY_HYPERBOLIC)
+const float curvature = -1.0;
+#elif defined(GEOMETRY_SPHERICAL)
+const float curvature = 1.0;
+#else
+const float curvature = 0.0;
+#endif
 
-uniform Light[8] lights;
-uniform int   nLights;
-uniform vec4  wEye;
+uniform mat4  ScaleRotateMatrix;
+uniform mat4  NormalMatrix;                         // transpose(inverse(ScaleRotateMatrix))
+uniform mat4  TranslateMatrix;
+uniform bool  instanced;                            // take the modeling transform from the instance attributes
+uniform bool  octahedralNormals;                    // eucVtxNorm.xy holds an octahedral encoded normal
 
 layout(location = 0) in vec4  eucVtxPos;            // pos in modeling space
-layout(location = 1) in vec4  eucVtxNorm;      	 // normal in modeling space
+layout(location = 1) in vec4  eucVtxNorm;      	 // normal in modeling space, see decodeNormal
 layout(location = 2) in vec2  vtxUV;
+layout(location = 3) in mat4  instanceScaleRotate;  // per instance, transposed: rows arrive as columns
+layout(location = 7) in mat4  instanceTranslate;
+layout(location = 11) in mat4 instanceNormal;
 
 out vec4 wNormal;		    // normal in world space
-out vec4 wView;             // view in world space
-out vec4 wLight[8];		    // light dir in world space
+out vec4 wPos;              // position in world space, the view and light directions are taken in geom.frag
 out vec2 texcoord;
 
-float dotGeom(vec4 u, vec4 v) {
-    float LorentzSign = curvature < 0.0 ? -1.0 : 1.0;
-    return u.x * v.x + u.y * v.y + u.z * v.z + LorentzSign * u.w * v.w;
-}
-
-vec4 direction(vec4 to, vec4 from) {
-    if(curvature == 0.0) { //EUCLIDEAN
-        return normalize(to - from);
-    }
-    if (curvature > 0.0) { //SPHERICAL
-        float cosd = dotGeom(from, to);
-        float sind = sqrt(1.0 - cosd * cosd);
-        return (to - from * cosd)/sind;
-    }
-    if (curvature < 0.0) { //HYPERBOLIC
-        float coshd = -dotGeom(from, to);
-        float sinhd = sqrt(coshd * coshd - 1.0);
-        return (to - from * coshd)/sinhd;
-    }
-    
-}
-
 vec4 transformPointToCurrentSpace(vec4 eucPoint) {
-    if (curvature == 0.0) { //EUCLIDEAN
-        return eucPoint;
-    }
-    
+#if defined(GEOMETRY_HYPERBOLIC) || defined(GEOMETRY_SPHERICAL)
     vec3 P = eucPoint.xyz;
     float dist = sqrt(dot(P,P)) + 0.000001;
     vec4 v = vec4(P/dist, 0.0);
-
-    if (curvature > 0.0) { //SPHERICAL
-        return vec4(0.0,0.0,0.0,1.0) * cos(dist) + v * sin(dist);
-    }
-    if (curvature < 0.0) { //HYPERBOLIC
-        return vec4(0.0,0.0,0.0,1.0) * cosh(dist) + v * sinh(dist);
-    }
+#ifdef GEOMETRY_SPHERICAL
+    return vec4(0.0,0.0,0.0,1.0) * cos(dist) + v * sin(dist);
+#else
+    return vec4(0.0,0.0,0.0,1.0) * cosh(dist) + v * sinh(dist);
+#endif
+#else
+    return eucPoint;
+#endif
 }
     
 
@@ -79,20 +72,28 @@ vec4 transformVectorToCurrentSpace(vec4 vector, vec4 point) {
 		vec4(-(alpha * (z*x / (1.0 + w))),		-(alpha * (z*y / (1.0 + w))),		1.0 - (alpha * (z*z / (1.0 + w))),	-alpha * z),
 		vec4(x,								y,								z,							w));
 }
+vec4 decodeNormal(vec4 encoded) {
+    if (!octahedralNormals) return encoded;
+    vec3 n = vec3(encoded.xy, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return vec4(normalize(n), 0.0);
+}
+
 void main() {
-    vec4 wPos = transformPointToCurrentSpace(
-        eucVtxPos * ScaleMatrix * RotateMatrix
-    ) * TranslateMatrix;
-    gl_Position = wPos * VPMatrix;
+    mat4 ScaleRotate = instanced ? transpose(instanceScaleRotate) : ScaleRotateMatrix;
+    mat4 Translate = instanced ? transpose(instanceTranslate) : TranslateMatrix;
+    mat4 Normal = instanced ? transpose(instanceNormal) : NormalMatrix;
 
-    for(int i = 0; i < nLights; i++) {
-        wLight[i] = direction(transformPointToCurrentSpace(lights[i].wLightPos), wPos);
-    }
-    
-    wView  = direction(transformPointToCurrentSpace(wEye), wPos);
+    wPos = transformPointToCurrentSpace(
+        eucVtxPos * ScaleRotate
+    ) * Translate;
+    gl_Position = wPos * VPMatrix;
 
     wNormal = transformVectorToCurrentSpace(
-        eucVtxNorm * transpose(inverse(ScaleMatrix * RotateMatrix)),
+        decodeNormal(eucVtxNorm) * Normal,
         wPos
     );
 
@@ -0,0 +1,115 @@
+#include "image.h"
+#include <stdio.h>
+
+bool Image::writePPM(const std::string& path) const {
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		printf("Cannot open %s for writing\n", path.c_str());
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	fwrite(pixels.data(), 1, pixels.size(), file);
+	fclose(file);
+	return true;
+}
+
+namespace {
+
+unsigned int crc32(const unsigned char* data, size_t length, unsigned int crc = 0) {
+	static unsigned int table[256];
+	static bool tableReady = false;
+	if (!tableReady) {
+		for (unsigned int n = 0; n < 256; n++) {
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		tableReady = true;
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+void putBigEndian(std::vector<unsigned char>& out, unsigned int value) {
+	out.push_back((value >> 24) & 0xFF);
+	out.push_back((value >> 16) & 0xFF);
+	out.push_back((value >> 8) & 0xFF);
+	out.push_back(value & 0xFF);
+}
+
+void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data) {
+	std::vector<unsigned char> chunk;
+	putBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc32(&chunk[4], chunk.size() - 4));
+	fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+} // namespace
+
+// Writes the pixels as a zlib stream of stored (uncompressed) deflate blocks,
+// which keeps the writer dependency free. Frames are meant to be fast to write,
+// not small.
+bool Image::writePNG(const std::string& path) const {
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		printf("Cannot open %s for writing\n", path.c_str());
+		return false;
+	}
+	const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fwrite(signature, 1, 8, file);
+
+	std::vector<unsigned char> header;
+	putBigEndian(header, width);
+	putBigEndian(header, height);
+	header.push_back(8); // bit depth
+	header.push_back(2); // truecolor
+	header.push_back(0); header.push_back(0); header.push_back(0);
+	writeChunk(file, "IHDR", header);
+
+	// every row starts with filter type 0
+	size_t rowSize = (size_t)width * 3;
+	std::vector<unsigned char> raw;
+	raw.reserve((rowSize + 1) * height);
+	for (int y = 0; y < height; y++) {
+		raw.push_back(0);
+		raw.insert(raw.end(), pixels.begin() + y * rowSize, pixels.begin() + (y + 1) * rowSize);
+	}
+
+	std::vector<unsigned char> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78); zlib.push_back(0x01);
+	unsigned int a = 1, b = 0;
+	for (size_t pos = 0; pos < raw.size() || pos == 0; ) {
+		size_t blockSize = raw.size() - pos < 65535 ? raw.size() - pos : 65535;
+		bool last = pos + blockSize == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(blockSize & 0xFF); zlib.push_back(blockSize >> 8);
+		zlib.push_back(~blockSize & 0xFF); zlib.push_back((~blockSize >> 8) & 0xFF);
+		for (size_t i = pos; i < pos + blockSize; ) { // adler32, reduced every 5552 bytes
+			size_t end = i + 5552 < pos + blockSize ? i + 5552 : pos + blockSize;
+			for (; i < end; i++) {
+				a += raw[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + blockSize);
+		pos += blockSize;
+		if (last) break;
+	}
+	putBigEndian(zlib, (b << 16) | a);
+	writeChunk(file, "IDAT", zlib);
+	writeChunk(file, "IEND", std::vector<unsigned char>());
+
+	fclose(file);
+	return true;
+}
+
+bool Image::write(const std::string& path) const {
+	if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0) return writePNG(path);
+	return writePPM(path);
+}
@@ -0,0 +1,20 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <string>
+#include <vector>
+
+// 8 bit RGB image, rows stored top to bottom.
+struct Image {
+	int width = 0, height = 0;
+	std::vector<unsigned char> pixels;
+
+	Image() {}
+	Image(int _width, int _height) : width(_width), height(_height), pixels(_width * _height * 3, 0) {}
+
+	bool writePPM(const std::string& path) const;
+	bool writePNG(const std::string& path) const;
+	bool write(const std::string& path) const; // picks the format from the extension
+};
+
+#endif // IMAGE_H
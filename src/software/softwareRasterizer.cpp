@@ -0,0 +1,338 @@
+#include "softwareRasterizer.h"
+#include "nonEuclideanMath.h"
+#include "parallel.h"
+
+// clip space position followed by the varyings
+const int clipStride = 4 + softwareVaryings;
+
+// Vertices are shaded on all cores above this count
+const int parallelVertexCount = 8192;
+
+namespace {
+
+inline vec4 normalize4(const vec4& v) {
+	return v * (1 / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w));
+}
+
+// toCurrentSpace() of geom.frag
+template<class Space> vec4 toCurrentSpace(const vec4& p) {
+	if constexpr (Space::curvature == 0.0f) return p;
+	else return p * (1 / sqrtf(fabsf(smartDot<Space>(p, p))));
+}
+
+// direction() of geom.frag
+template<class Space> vec4 direction(const vec4& to, const vec4& from) {
+	if constexpr (Space::curvature == 0.0f) return normalize4(to - from);
+	else return normalize4(to - from * (Space::curvature * smartDot<Space>(from, to)));
+}
+
+inline void storeVec4(float* out, const vec4& v) {
+	out[0] = v.x; out[1] = v.y; out[2] = v.z; out[3] = v.w;
+}
+
+inline vec4 loadVec4(const float* in) {
+	return vec4(in[0], in[1], in[2], in[3]);
+}
+
+vec3 sampleTexture(const SoftwareTexture* texture, float u, float v) {
+	if (!texture || texture->image.empty()) return vec3(0, 0, 0);
+	int w = texture->width, h = texture->height;
+	const std::vector<vec4>& image = texture->image;
+	auto texel = [&](int x, int y) {
+		x %= w; if (x < 0) x += w;
+		y %= h; if (y < 0) y += h;
+		const vec4& c = image[y * w + x];
+		return vec3(c.x, c.y, c.z);
+	};
+	if (texture->sampling == GL_NEAREST) {
+		return texel((int)floorf(u * w), (int)floorf(v * h));
+	}
+	float x = u * w - 0.5f, y = v * h - 0.5f;
+	int x0 = (int)floorf(x), y0 = (int)floorf(y);
+	float fx = x - x0, fy = y - y0;
+	return (texel(x0, y0) * (1 - fx) + texel(x0 + 1, y0) * fx) * (1 - fy) +
+		   (texel(x0, y0 + 1) * (1 - fx) + texel(x0 + 1, y0 + 1) * fx) * fy;
+}
+
+// main() of geom.frag
+template<class Space> vec3 shadeFragment(const SoftwareDraw& draw, const float* varyings) {
+	vec4 P = toCurrentSpace<Space>(loadVec4(varyings + 4));
+	vec4 N = normalize4(loadVec4(varyings));
+	vec4 V = direction<Space>(draw.eye, P);
+	vec3 texColor = sampleTexture(draw.texture, varyings[8], varyings[9]);
+	const Material& material = draw.material;
+	vec3 ka = material.ka * texColor;
+	vec3 kd = material.kd * texColor;
+
+	vec3 radiance = texColor * material.emission;
+	for (int i = 0; i < draw.nLights; i++) {
+		vec4 L = direction<Space>(draw.lightPositions[i], P);
+		vec4 H = normalize4(L + V);
+		float cost = fmaxf(smartDot<Space>(N, L), 0.0f);
+		float cosd = fmaxf(smartDot<Space>(N, H), 0.0f);
+		radiance = radiance + ka * draw.La[i] + (kd * cost + material.ks * powf(cosd, material.shininess)) * draw.Le[i];
+	}
+	return radiance;
+}
+
+inline float edge(const SoftwareVertex& a, const SoftwareVertex& b, float x, float y) {
+	return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+inline unsigned char toByte(float c) {
+	if (!(c > 0.0f)) return 0;
+	if (c >= 1.0f) return 255;
+	return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+} // namespace
+
+SoftwareRasterizer::SoftwareRasterizer(int _width, int _height, unsigned int _nThreads) {
+	width = _width;
+	height = _height;
+	nThreads = _nThreads > 0 ? _nThreads : hardwareThreadCount();
+	beginFrame();
+}
+
+unsigned int SoftwareRasterizer::createMesh(std::vector<VertexData>&& vertices, std::vector<unsigned int>&& indices) {
+	meshes.push_back(std::unique_ptr<SoftwareMesh>(new SoftwareMesh{ std::move(vertices), std::move(indices) }));
+	return (unsigned int)meshes.size();
+}
+
+void SoftwareRasterizer::deleteMesh(unsigned int mesh) {
+	if (mesh > 0 && mesh <= meshes.size()) meshes[mesh - 1].reset();
+}
+
+unsigned int SoftwareRasterizer::createTexture(int width, int height, const std::vector<vec4>& image, int sampling) {
+	textures.push_back(std::unique_ptr<SoftwareTexture>(new SoftwareTexture{ width, height, sampling, image }));
+	return (unsigned int)textures.size();
+}
+
+void SoftwareRasterizer::deleteTexture(unsigned int texture) {
+	if (texture > 0 && texture <= textures.size()) textures[texture - 1].reset();
+}
+
+void SoftwareRasterizer::beginFrame(const vec3& clearColor) {
+	frame = SoftwareFrame();
+	frame.width = width;
+	frame.height = height;
+	frame.tilesX = (width + softwareTileSize - 1) / softwareTileSize;
+	frame.tilesY = (height + softwareTileSize - 1) / softwareTileSize;
+	frame.clearColor = clearColor;
+	frame.tiles.resize(frame.tilesX * frame.tilesY);
+}
+
+SoftwareFrame SoftwareRasterizer::endFrame() {
+	SoftwareFrame recorded = std::move(frame);
+	beginFrame(recorded.clearColor);
+	return recorded;
+}
+
+void SoftwareRasterizer::bind(const RenderState& state) {
+	static Material defaultMaterial;
+
+	uniforms.ScaleRotate = state.ScaleRotate;
+	uniforms.Normal = state.Normal;
+	uniforms.Translate = state.Translate;
+	uniforms.VP = state.VP;
+
+	SoftwareDraw draw;
+	draw.material = state.material ? *state.material : defaultMaterial;
+	unsigned int texture = state.texture ? state.texture->textureId : 0;
+	draw.texture = texture > 0 && texture <= textures.size() ? textures[texture - 1].get() : nullptr;
+	draw.nLights = std::min(std::min(state.nLights, maxSoftwareLights), maxLights);
+	draw.curvature = Curvature::getCurvature();
+	draw.eye = state.eye;
+	for (int i = 0; i < draw.nLights; i++) {
+		draw.La[i] = state.lights[i].La;
+		draw.Le[i] = state.lights[i].Le;
+		draw.lightPositions[i] = state.lightPositions[i];
+	}
+	frame.draws.push_back(draw);
+}
+
+// main() of geom.vert
+template<class Space>
+void SoftwareRasterizer::shadeVertices(const VertexData* vertices, int count, std::vector<float>& out) const {
+	const int chunk = 1024;
+	auto shadeChunk = [&](int c) {
+		int end = (c + 1) * chunk < count ? (c + 1) * chunk : count;
+		for (int i = c * chunk; i < end; i++) {
+			float* o = &out[(size_t)i * clipStride];
+			vec4 wPos = transformPointToCurrentSpace<Space>(vertices[i].position * uniforms.ScaleRotate) * uniforms.Translate;
+			storeVec4(o, wPos * uniforms.VP);
+			float* varyings = o + 4;
+			storeVec4(varyings, transformVectorToCurrentSpace<Space>(vertices[i].normal * uniforms.Normal, wPos));
+			storeVec4(varyings + 4, wPos);
+			varyings[8] = vertices[i].texcoord.x;
+			varyings[9] = vertices[i].texcoord.y;
+		}
+	};
+	int nChunks = (count + chunk - 1) / chunk;
+	parallelFor(nChunks, shadeChunk, count >= parallelVertexCount ? nThreads : 1);
+}
+
+void SoftwareRasterizer::drawMesh(unsigned int mesh, unsigned int nIndices) {
+	if (mesh == 0 || mesh > meshes.size() || !meshes[mesh - 1]) return;
+	const SoftwareMesh& stored = *meshes[mesh - 1];
+	drawIndexedTriangleStrip(stored.vertices.data(), (unsigned int)stored.vertices.size(), stored.indices.data(), nIndices);
+}
+
+void SoftwareRasterizer::drawIndexedTriangleStrip(const VertexData* vertices, unsigned int nVertices, const unsigned int* indices, unsigned int nIndices) {
+	if (frame.draws.empty()) return; // nothing bound
+	std::vector<float> shaded((size_t)nVertices * clipStride);
+	dispatchCurvature([&](auto space) {
+		shadeVertices<decltype(space)>(vertices, (int)nVertices, shaded);
+	});
+	for (unsigned int k = 0; k + 2 < nIndices; k++) {
+		unsigned int a = indices[k], b = indices[k + 1], c = indices[k + 2];
+		if (a == b || b == c || a == c) continue;
+		clipAndBin(&shaded[(size_t)a * clipStride], &shaded[(size_t)b * clipStride], &shaded[(size_t)c * clipStride]);
+	}
+}
+
+// Clips the triangle against the canonical view volume, projects it to the
+// screen and adds the resulting triangles to the bins of the tiles they touch.
+void SoftwareRasterizer::clipAndBin(const float* a, const float* b, const float* c) {
+	const int maxPolygon = 9;
+	float polygons[2][maxPolygon][clipStride];
+	int n = 3;
+	for (int k = 0; k < clipStride; k++) {
+		polygons[0][0][k] = a[k];
+		polygons[0][1][k] = b[k];
+		polygons[0][2][k] = c[k];
+	}
+
+	int src = 0;
+	for (int plane = 0; plane < 6; plane++) {
+		int axis = plane / 2;
+		float sign = (plane & 1) ? -1.0f : 1.0f;
+		auto distance = [&](const float* v) { return v[3] + sign * v[axis]; };
+
+		int m = 0;
+		for (int i = 0; i < n; i++) {
+			const float* p = polygons[src][i];
+			const float* q = polygons[src][(i + 1) % n];
+			float dp = distance(p), dq = distance(q);
+			if (dp >= 0 && m < maxPolygon) {
+				for (int k = 0; k < clipStride; k++) polygons[1 - src][m][k] = p[k];
+				m++;
+			}
+			if ((dp >= 0) != (dq >= 0) && m < maxPolygon) {
+				float t = dp / (dp - dq);
+				for (int k = 0; k < clipStride; k++) polygons[1 - src][m][k] = p[k] + (q[k] - p[k]) * t;
+				m++;
+			}
+		}
+		src = 1 - src;
+		n = m;
+		if (n < 3) return;
+	}
+
+	SoftwareVertex projected[maxPolygon];
+	for (int i = 0; i < n; i++) {
+		const float* v = polygons[src][i];
+		if (v[3] <= 0) return;
+		float invW = 1 / v[3];
+		SoftwareVertex& s = projected[i];
+		s.x = (v[0] * invW * 0.5f + 0.5f) * width;
+		s.y = (v[1] * invW * 0.5f + 0.5f) * height;
+		s.depth = v[2] * invW * 0.5f + 0.5f;
+		s.invW = invW;
+		for (int k = 0; k < softwareVaryings; k++) s.varyings[k] = v[4 + k] * invW;
+	}
+
+	for (int i = 1; i + 1 < n; i++) {
+		const SoftwareVertex& v0 = projected[0];
+		const SoftwareVertex& v1 = projected[i];
+		const SoftwareVertex& v2 = projected[i + 1];
+		if (fabsf(edge(v0, v1, v2.x, v2.y)) < 1e-8f) continue;
+
+		float minX = fminf(v0.x, fminf(v1.x, v2.x)), maxX = fmaxf(v0.x, fmaxf(v1.x, v2.x));
+		float minY = fminf(v0.y, fminf(v1.y, v2.y)), maxY = fmaxf(v0.y, fmaxf(v1.y, v2.y));
+		int tx0 = (int)fmaxf(0.0f, minX) / softwareTileSize, tx1 = (int)fminf(width - 1.0f, maxX) / softwareTileSize;
+		int ty0 = (int)fmaxf(0.0f, minY) / softwareTileSize, ty1 = (int)fminf(height - 1.0f, maxY) / softwareTileSize;
+
+		SoftwareTriangle triangle;
+		triangle.v[0] = v0;
+		triangle.v[1] = v1;
+		triangle.v[2] = v2;
+		triangle.draw = (int)frame.draws.size() - 1;
+		unsigned int index = (unsigned int)frame.triangles.size();
+		frame.triangles.push_back(triangle);
+		for (int ty = ty0; ty <= ty1; ty++) {
+			for (int tx = tx0; tx <= tx1; tx++) frame.tiles[ty * frame.tilesX + tx].push_back(index);
+		}
+	}
+}
+
+Image SoftwareRasterizer::rasterize(const SoftwareFrame& recorded) const {
+	PROFILE_ZONE("SoftwareRasterizer::rasterize");
+	Image image(recorded.width, recorded.height);
+
+	parallelFor(recorded.tilesX * recorded.tilesY, [&](int tile) {
+		int tx = tile % recorded.tilesX, ty = tile / recorded.tilesX;
+		int x0 = tx * softwareTileSize, y0 = ty * softwareTileSize;
+		int x1 = x0 + softwareTileSize < recorded.width ? x0 + softwareTileSize : recorded.width;
+		int y1 = y0 + softwareTileSize < recorded.height ? y0 + softwareTileSize : recorded.height;
+
+		float depth[softwareTileSize * softwareTileSize];
+		vec3 color[softwareTileSize * softwareTileSize];
+		for (int i = 0; i < softwareTileSize * softwareTileSize; i++) {
+			depth[i] = 1.0f;
+			color[i] = recorded.clearColor;
+		}
+
+		float varyings[softwareVaryings];
+		for (unsigned int index : recorded.tiles[tile]) {
+			const SoftwareTriangle& triangle = recorded.triangles[index];
+			const SoftwareVertex& v0 = triangle.v[0];
+			const SoftwareVertex& v1 = triangle.v[1];
+			const SoftwareVertex& v2 = triangle.v[2];
+			const SoftwareDraw& draw = recorded.draws[triangle.draw];
+
+			float area = edge(v0, v1, v2.x, v2.y);
+			float invArea = 1 / area;
+			int px0 = (int)fmaxf((float)x0, floorf(fminf(v0.x, fminf(v1.x, v2.x))));
+			int px1 = (int)fminf(x1 - 1.0f, ceilf(fmaxf(v0.x, fmaxf(v1.x, v2.x))));
+			int py0 = (int)fmaxf((float)y0, floorf(fminf(v0.y, fminf(v1.y, v2.y))));
+			int py1 = (int)fminf(y1 - 1.0f, ceilf(fmaxf(v0.y, fmaxf(v1.y, v2.y))));
+
+			// the space is picked per triangle, the fragments are shaded without branching on it
+			dispatchCurvature(draw.curvature, [&](auto space) {
+				for (int py = py0; py <= py1; py++) {
+					for (int px = px0; px <= px1; px++) {
+						float x = px + 0.5f, y = py + 0.5f;
+						float l0 = edge(v1, v2, x, y) * invArea;
+						float l1 = edge(v2, v0, x, y) * invArea;
+						float l2 = edge(v0, v1, x, y) * invArea;
+						if (l0 < 0 || l1 < 0 || l2 < 0) continue;
+
+						float z = l0 * v0.depth + l1 * v1.depth + l2 * v2.depth;
+						int pixel = (py - y0) * softwareTileSize + (px - x0);
+						if (!(z < depth[pixel])) continue; // GL_LESS
+
+						float w = 1 / (l0 * v0.invW + l1 * v1.invW + l2 * v2.invW);
+						for (int k = 0; k < softwareVaryings; k++) {
+							varyings[k] = (l0 * v0.varyings[k] + l1 * v1.varyings[k] + l2 * v2.varyings[k]) * w;
+						}
+						depth[pixel] = z;
+						color[pixel] = shadeFragment<decltype(space)>(draw, varyings);
+					}
+				}
+			});
+		}
+
+		for (int y = y0; y < y1; y++) {
+			unsigned char* row = &image.pixels[(size_t)(recorded.height - 1 - y) * recorded.width * 3];
+			for (int x = x0; x < x1; x++) {
+				const vec3& c = color[(y - y0) * softwareTileSize + (x - x0)];
+				row[3 * x + 0] = toByte(c.x);
+				row[3 * x + 1] = toByte(c.y);
+				row[3 * x + 2] = toByte(c.z);
+			}
+		}
+	}, nThreads);
+
+	return image;
+}
@@ -0,0 +1,94 @@
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <memory>
+#include <vector>
+#include "framework.h"
+#include "image.h"
+
+// CPU implementation of the geom.vert / geom.frag pipeline, installed as the
+// RenderBackend: meshes and textures are kept here, GeomShader::Bind hands the
+// RenderState over and ParamGeometry::Draw submits its triangle strip. The scene
+// is recorded into a SoftwareFrame, which is then rasterized tile by tile on all cores.
+
+const int maxSoftwareLights = 8;
+const int softwareTileSize = 64;
+
+struct SoftwareTexture {
+	int width, height, sampling;
+	std::vector<vec4> image;
+};
+
+struct SoftwareMesh {
+	std::vector<VertexData> vertices;
+	std::vector<unsigned int> indices;
+};
+
+struct SoftwareDraw {       // what the fragment stage needs from a draw call
+	Material material;
+	const SoftwareTexture* texture;
+	int nLights;
+	vec3 La[maxSoftwareLights], Le[maxSoftwareLights];
+	vec4 eye, lightPositions[maxSoftwareLights];   // in the current space
+	float curvature;
+};
+
+// varyings: wNormal (0-3), wPos (4-7), texcoord (8-9)
+const int softwareVaryings = 10;
+
+struct SoftwareVertex {     // screen space position, varyings premultiplied by 1/w
+	float x, y, depth, invW;
+	float varyings[softwareVaryings];
+};
+
+struct SoftwareTriangle {
+	SoftwareVertex v[3];
+	int draw;
+};
+
+struct SoftwareFrame {
+	int width = 0, height = 0, tilesX = 0, tilesY = 0;
+	vec3 clearColor;
+	std::vector<SoftwareDraw> draws;
+	std::vector<SoftwareTriangle> triangles;
+	std::vector<std::vector<unsigned int>> tiles; // triangle indices, in submission order
+};
+
+class SoftwareRasterizer : public RenderBackend {
+	struct VertexUniforms {
+		mat4 ScaleRotate, Normal, Translate, VP;
+	};
+
+	int width, height;
+	unsigned int nThreads;
+	SoftwareFrame frame;
+	VertexUniforms uniforms;
+	// handle - 1 indexes these, the pointers stay valid while frames are rasterized
+	std::vector<std::unique_ptr<SoftwareMesh>> meshes;
+	std::vector<std::unique_ptr<SoftwareTexture>> textures;
+
+	void clipAndBin(const float* a, const float* b, const float* c);
+	template<class Space> void shadeVertices(const VertexData* vertices, int count, std::vector<float>& out) const;
+
+public:
+	SoftwareRasterizer(int _width, int _height, unsigned int _nThreads = 0);
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	unsigned int createMesh(std::vector<VertexData>&& vertices, std::vector<unsigned int>&& indices) override;
+	void deleteMesh(unsigned int mesh) override;
+	unsigned int createTexture(int width, int height, const std::vector<vec4>& image, int sampling) override;
+	void deleteTexture(unsigned int texture) override;
+
+	void beginFrame(const vec3& clearColor = vec3(0, 0, 0));
+	void bind(const RenderState& state) override;
+	void drawMesh(unsigned int mesh, unsigned int nIndices) override;
+	// degenerate triangles (repeated indices) of a stitched strip are skipped
+	void drawIndexedTriangleStrip(const VertexData* vertices, unsigned int nVertices, const unsigned int* indices, unsigned int nIndices);
+	SoftwareFrame endFrame(); // hands the recorded frame over, a new one can be recorded meanwhile
+
+	Image rasterize(const SoftwareFrame& recorded) const;
+	Image renderFrame() { return rasterize(endFrame()); }
+};
+
+#endif // SOFTWARE_RASTERIZER_H